@@ -21,235 +21,400 @@ inline bool operator<(const row &a, const row &b)
 {
 	return (a.origY < b.origY) || (a.origY == b.origY && a.origX < b.origX);
 }
-inline bool operator<(const cell &a, const cell &b)
-{
-	return (a.y_coord < b.y_coord) || (a.y_coord == b.y_coord && a.x_coord < b.x_coord);
-}
 
-/* ************************************************************* */
-/* For legality check,                                           */
-/* 1) slice multi-row objects into multiple single-row objects,  */
-/* 2) and sort rows & objects based on locations                 */
-/* NOTE:  assume all macros are rectangular                      */
-/* ************************************************************* */
-void circuit::sort_and_slice_objects()
+/* ********************************************************************** */
+/* Checks ILLEGAL_TYPE 4, 5 & 6 on one line at y: lineCells are the cells */
+/* with a slice at y, & rowOrder[first] .. rowOrder[last-1] the rows      */
+/* there (none for a y off the rows, where only overlaps are checked).   */
+/* counts go to errors[], messages to logs[]                              */
+/* ********************************************************************** */
+void circuit::check_row_legality(int y, const vector<unsigned> &lineCells, unsigned first, unsigned last, 
+		const vector<unsigned> &rowOrder, unsigned errors[6], ostringstream logs[6])
 {
-	unsigned init_num_cell = cells.size();
-	for(unsigned i=0 ; i<init_num_cell ; i++)
-	//for(vector<cell>::iterator theCell=cells.begin() ; theCell != cells.end() ; ++theCell)
+	vector<legality_entry> index(lineCells.size());
+	for(unsigned e=0 ; e<lineCells.size() ; e++)
 	{
+		index[e].y = y;
+		index[e].x = cell_x[ lineCells[e] ];
+		index[e].width = llround(cells[ lineCells[e] ].width);
+		index[e].id = lineCells[e];
+	}
+	sort(index.begin(), index.end(), [](const legality_entry &a, const legality_entry &b) {
+		return (a.x < b.x) || (a.x == b.x && a.id < b.id); });
+
+	unsigned rowSeg = first;            /* the last row starting at or left of x */
+	for(unsigned e=0 ; e<index.size() ; e++)
+	{
+		const legality_entry &entry = index[e];
+		unsigned i = entry.id;
 		cell *theCell=&cells[i];
-		if(theCell->height == rowHeight)
+
+		// ILLEGAL_TYPE 5: is there any overlap among the nodes (movable and/or fixed) within a row?  
+		if(e > 0 && index[e-1].x + index[e-1].width > entry.x)
+		{
+			const legality_entry &prev = index[e-1];
+			logs[4] << "ILLEGAL TYPE 5 : node " << cells[prev.id].name <<" overlaps with node " << theCell->name <<". ";
+			logs[4] << "(" << prev.x << " to "<< prev.x+cells[prev.id].width << ", "<< y << "), (" << entry.x <<", "<< y << ")" << endl;
+			errors[4]++;
+		}
+
+		/* the other checks are for movable cells, on their lowest row */
+		if(theCell->isFixed || cell_y[i] != y || first == last)
 			continue;
+		while(rowSeg+1 < last && rows[ rowOrder[rowSeg+1] ].origX <= entry.x)
+			rowSeg++;
+		row *theRow = &rows[ rowOrder[rowSeg] ];
+
+		// ILLEGAL_TYPE 4: is a movable node placed within the row sites?          
+		if(cell_x[i] < theRow->origX || cell_x[i]+theCell->width > theRow->origX + theRow->numSites * theRow->stepX)
+		{
+			logs[3] << "ILLEGAL TYPE 4 : Movable node " << theCell->name <<" is not within a row site. ";
+			logs[3] << "(" << cell_x[i] << ", "<< cell_y[i] << ")" << endl;
+			errors[3]++;
+		}
 
-		//NOTE: no movable macros in this contest
-		assert(theCell->isFixed);
-		//NOTE: the fixed macro should be aligned
-		assert((int)((theCell->y_coord-by)/rowHeight)*rowHeight+by == theCell->y_coord);
-		for(int y_coord = theCell->y_coord+rowHeight ; y_coord < theCell->y_coord + theCell->height ; y_coord+=rowHeight)
+		// ILLEGAL_TYPE 6: is a movable node placed on a multiple of siteX?          
+		if(cell_x[i] < theRow->origX || (cell_x[i] - theRow->origX) % theRow->stepX != 0)
 		{
-			cell slicedCell;
-			slicedCell.name = theCell->name;
-			slicedCell.isFixed = theCell->isFixed;
-			slicedCell.x_coord = theCell->x_coord;
-			slicedCell.y_coord = y_coord;
-			slicedCell.width   = theCell->width;
-			slicedCell.height  = rowHeight;
-			cells.push_back(slicedCell);
+			logs[5] << "ILLEGAL TYPE 6 : Movable node " << theCell->name <<" is not aligned to a row site. ";
+			logs[5] << "(" << cell_x[i] << ", "<< cell_y[i] << ")" << endl;
+			errors[5]++;
 		}
-		theCell->height = rowHeight;
 	}
-	sort(rows.begin(), rows.end());
-	sort(cells.begin(), cells.end());
 	return;
 }
 
-/* ************************************************************* */
-/* Performs legality check                                       */
-/* save the log in check_legality.log if placement is illegal    */
-/* ************************************************************* */
-
-bool circuit::check_legality()
+/* ********************************************************************** */
+/* Counts the violations of each ILLEGAL_TYPE (errors[0] for TYPE 1, ..)  */
+/* with the cell slices bucketed by y, on the row lines & off them, each  */
+/* line checked on its own by a pool of threads. the buckets are local,  */
+/* so cells & rows are left untouched & it can run at any time. messages */
+/* go to logs[], in a fixed order (by cell for TYPE 1, 2 & 3, by line    */
+/* then x for the others), when given                                    */
+/* ********************************************************************** */
+void circuit::legality_by_rows(unsigned errors[6], string* logs)
 {
-	ofstream log("check_legality.log");
-	// ILLEGAL_TYPE 1: did a terminal node move?                         
-	unsigned error_type_1=0;
-	cout << "  Testing ILLEGAL_TYPE 1 .. ";
-	for(vector<cell>::iterator theCell=cells.begin() ; theCell != cells.end() ; ++theCell)
-	{
-		if(!theCell->isFixed)
-			continue;
-
-		if(theCell->init_x_coord != theCell->x_coord || theCell->init_y_coord != theCell->y_coord) 
+	vector<unsigned> rowOrder(rows.size());
+	for(unsigned r=0 ; r<rows.size() ; r++)
+		rowOrder[r] = r;
+	sort(rowOrder.begin(), rowOrder.end(), [this](unsigned a, unsigned b) { return rows[a] < rows[b]; });
+	vector<unsigned> lineStart;         /* the first row of each line in rowOrder */
+	map<int, unsigned> lineAt;          /* y -> line, the row lines first */
+	for(unsigned r=0 ; r<rowOrder.size() ; r++)
+		if(r == 0 || rows[ rowOrder[r] ].origY != rows[ rowOrder[r-1] ].origY)
 		{
-			log << "ILLEGAL TYPE 1 : Fixed node " << theCell->name <<" is moved. ";
-			log << "(" << theCell->init_x_coord << "," << theCell->init_y_coord << ") -> ";
-			log << "(" << theCell->x_coord << "," << theCell->y_coord << ")" << endl;
-			error_type_1++;
+			lineAt[ rows[ rowOrder[r] ].origY ] = lineStart.size();
+			lineStart.push_back(r);
 		}
-	}
-	cout << error_type_1 <<endl;
+	unsigned numRowLines = lineStart.size();
 
-  // ILLEGAL_TYPE 2: is a movable node flipping/rotated/mirrored?        
-	unsigned error_type_2=0;
-	cout << "  Testing ILLEGAL_TYPE 2 .. ";
-	for(vector<cell>::iterator theCell=cells.begin() ; theCell != cells.end() ; ++theCell)
-	{
-		if(theCell->isFixed)
-			continue;
+	/* the slices at y, y+rowHeight, .. below the top of each cell, by line; */
+	/* a y on no row gets a line with no rows                                */
+	vector< vector<unsigned> > lineCells(numRowLines);
+	vector<unsigned> unrowed;           /* movable cells whose y is on no row */
+	map<int, unsigned> offRowAt;        /* y -> index into lineCells, past the row lines */
+	for(unsigned i=0 ; i<cells.size() ; i++)
+		for(int y = cell_y[i] ; y == cell_y[i] || y < cell_y[i] + cells[i].height ; y += (int)rowHeight)
+		{
+			map<int, unsigned>::iterator it = lineAt.find(y);
+			if(it == lineAt.end())
+			{
+				if(y == cell_y[i] && !cells[i].isFixed)
+					unrowed.push_back(i);
+				it = offRowAt.find(y);
+				if(it == offRowAt.end())
+				{
+					it = offRowAt.insert(make_pair(y, lineCells.size())).first;
+					lineCells.push_back(vector<unsigned>());
+				}
+			}
+			lineCells[it->second].push_back(i);
+		}
+	vector<int> lineY(lineCells.size());
+	for(map<int, unsigned>::iterator it = lineAt.begin() ; it != lineAt.end() ; ++it)
+		lineY[it->second] = it->first;
+	for(map<int, unsigned>::iterator it = offRowAt.begin() ; it != offRowAt.end() ; ++it)
+		lineY[it->second] = it->first;
+	lineStart.push_back(rowOrder.size());
+	unsigned numLines = lineCells.size();
 
-		if(theCell->cellorient != "N")
+	/* ILLEGAL_TYPE 4, 5 & 6 per line; lines are handed out one at a time */
+	vector<unsigned> lineErrors(6*numLines, 0);
+	vector<string> lineLogs(6*numLines);
+	atomic<unsigned> nextLine(0);
+	unsigned numThreads = max(1u, thread::hardware_concurrency());
+	numThreads = min(numThreads, max(numLines, 1u));
+	run_threads(numThreads, [&](unsigned t) {
+		for(unsigned l = nextLine++ ; l < numLines ; l = nextLine++)
 		{
-			log << "ILLEGAL TYPE 2 : Movable node " << theCell->name <<" is not in its original orientation. ";
-			log << "(" << theCell->cellorient << ")" <<endl;
-			error_type_2++;
+			ostringstream rowLogs[6];
+			unsigned first = (l < numRowLines) ? lineStart[l] : 0, last = (l < numRowLines) ? lineStart[l+1] : 0;
+			check_row_legality(lineY[l], lineCells[l], first, last, rowOrder, &lineErrors[6*l], rowLogs);
+			for(unsigned k=0 ; k<6 ; k++)
+				lineLogs[6*l+k] = rowLogs[k].str();
 		}
-	}
-	cout << error_type_2 <<endl;
-
-  // ILLEGAL_TYPE 3: is a movable node placed aligned to the circuit rows?          
-	sort_and_slice_objects();
-	unsigned error_type_3=0;
-	unsigned row_index=0;
-	cout << "  Testing ILLEGAL_TYPE 3 .. ";
-	for(vector<cell>::iterator theCell=cells.begin() ; theCell != cells.end() ; ++theCell)
+	});
+
+	ostringstream cellLogs[6];
+	for(unsigned k=0 ; k<6 ; k++)
+		errors[k] = 0;
+	for(unsigned i=0 ; i<cells.size() ; i++)
 	{
+		cell *theCell=&cells[i];
+		// ILLEGAL_TYPE 1: did a terminal node move?                         
 		if(theCell->isFixed)
-			continue;
-
-		bool row_found = false;
-		for( ; row_index<rows.size() ; row_index++)
 		{
-			row *theRow=&rows[row_index]; 
-			if(theCell->y_coord > theRow->origY)
-				continue;
-
-			if(theCell->y_coord != theRow->origY)
+			if(theCell->init_x_coord != cell_x[i] || theCell->init_y_coord != cell_y[i]) 
 			{
-				log << "ILLEGAL TYPE 3 : Movable node " << theCell->name <<" is not aligned to a circuit row. ";
-				log << "(" << theCell->x_coord << ", "<< theCell->y_coord << ")" <<endl;
-				error_type_3++;
+				cellLogs[0] << "ILLEGAL TYPE 1 : Fixed node " << theCell->name <<" is moved. ";
+				cellLogs[0] << "(" << theCell->init_x_coord << "," << theCell->init_y_coord << ") -> ";
+				cellLogs[0] << "(" << cell_x[i] << "," << cell_y[i] << ")" << endl;
+				errors[0]++;
 			}
-			else
-				row_found=true;
-			break;
+			continue;
 		}
-		if(theCell->y_coord > rows[rows.size()-1].origY)
+
+		// ILLEGAL_TYPE 2: is a movable node flipping/rotated/mirrored?        
+		if(theCell->cellorient != "N")
 		{
-			log << "ILLEGAL TYPE 3 : Movable node " << theCell->name <<" is not aligned to a circuit row. ";
-			log << "(" << theCell->x_coord << ", "<< theCell->y_coord << ")" <<endl;
-			error_type_3++;
+			cellLogs[1] << "ILLEGAL TYPE 2 : Movable node " << theCell->name <<" is not in its original orientation. ";
+			cellLogs[1] << "(" << theCell->cellorient << ")" <<endl;
+			errors[1]++;
 		}
 	}
-	cout << error_type_3 <<endl;
 
-  // ILLEGAL_TYPE 4: is a movable node placed within the row sites?          
-	unsigned error_type_4=0;
-	row_index=0;
-	cout << "  Testing ILLEGAL_TYPE 4 .. ";
-	for(vector<cell>::iterator theCell=cells.begin() ; theCell != cells.end() ; ++theCell)
+	// ILLEGAL_TYPE 3: is a movable node placed aligned to the circuit rows?          
+	/* such a node is not within a row site (TYPE 4) nor on one (TYPE 6) either */
+	for(unsigned u=0 ; u<unrowed.size() ; u++)
 	{
-		if(theCell->isFixed)
+		unsigned i = unrowed[u];
+		cellLogs[2] << "ILLEGAL TYPE 3 : Movable node " << cells[i].name <<" is not aligned to a circuit row. ";
+		cellLogs[2] << "(" << cell_x[i] << ", "<< cell_y[i] << ")" <<endl;
+		cellLogs[3] << "ILLEGAL TYPE 4 : Movable node " << cells[i].name <<" is not within a row site. ";
+		cellLogs[3] << "(" << cell_x[i] << ", "<< cell_y[i] << ")" << endl;
+		cellLogs[5] << "ILLEGAL TYPE 6 : Movable node " << cells[i].name <<" is not aligned to a row site. ";
+		cellLogs[5] << "(" << cell_x[i] << ", "<< cell_y[i] << ")" << endl;
+		errors[2]++;
+		errors[3]++;
+		errors[5]++;
+	}
+
+	/* merge in line order, so the result does not depend on the threads */
+	for(unsigned k=0 ; k<6 ; k++)
+	{
+		for(unsigned l=0 ; l<numLines ; l++)
+			errors[k] += lineErrors[6*l+k];
+		if(!logs)
 			continue;
+		logs[k] = cellLogs[k].str();
+		for(unsigned l=0 ; l<numLines ; l++)
+			logs[k] += lineLogs[6*l+k];
+	}
+	return;
+}
 
-		for( ; row_index<rows.size() ; row_index++)
-		{
-			row *theRow=&rows[row_index];
-			if(theCell->y_coord > theRow->origY)
-				continue;
+/* ************************************************************* */
+/* Performs legality check                                       */
+/* save the log in check_legality.log if placement is illegal    */
+/* ************************************************************* */
+bool circuit::check_legality()
+{
+	unsigned errors[6];
+	string logs[6];
+	legality_by_rows(errors, logs);
 
-			bool within_row = false;
-			while(theCell->y_coord == theRow->origY)
-			{
-				if(theCell->x_coord >= theRow->origX)
-				{
-					if(theCell->x_coord+theCell->width <= theRow->origX + theRow->numSites * theRow->stepX)
-					{
-						within_row = true;
-						break;
-					}
-					break;
-				}
-				row_index++;
-				if(row_index > rows.size()-1)
-					break;
-				theRow = &rows[row_index];
-			}
-			if(!within_row)
-			{
-				log << "ILLEGAL TYPE 4 : Movable node " << theCell->name <<" is not within a row site. ";
-				log << "(" << theCell->x_coord << ", "<< theCell->y_coord << ")" << endl;
-				error_type_4++;
-			}
-			break;
-		}
+	unsigned total=0;
+	for(unsigned t=0 ; t<6 ; t++)
+	{
+		cout << "  Testing ILLEGAL_TYPE " << t+1 << " .. " << errors[t] <<endl;
+		total += errors[t];
 	}
-	cout << error_type_4 <<endl;
-	
-	// ILLEGAL_TYPE 5: is there any overlap among the nodes (movable and/or fixed) within a row?  
-	cout << "  Testing ILLEGAL_TYPE 5 .. ";
-	unsigned error_type_5=0;
-	for(vector<cell>::iterator currCell=cells.begin() ; currCell != cells.end()-1 ; ++currCell)
+	// NOTE: a log left over from an earlier, illegal run would be misleading
+	if(total == 0)
 	{
-		vector<cell>::iterator nextCell=currCell+1;
-		if(currCell->y_coord == nextCell->y_coord && currCell->x_coord + currCell->width > nextCell->x_coord )
+		remove("check_legality.log");
+		return true;
+	}
+
+	ofstream log("check_legality.log");
+	for(unsigned t=0 ; t<6 ; t++)
+		log << logs[t];
+	log.close();
+	return false;
+}
+
+/* ************************************************************* */
+/* Number of legality violations, without any output; for use    */
+/* inside an optimization loop                                   */
+/* ************************************************************* */
+unsigned circuit::legality_errors()
+{
+	unsigned errors[6];
+	legality_by_rows(errors, NULL);
+	return errors[0]+errors[1]+errors[2]+errors[3]+errors[4]+errors[5];
+}
+
+/* ********************************************************************** */
+/*  Desc: index the cells of each row line by x, as check_legality sees  */
+/*        them, & count the violations per ILLEGAL_TYPE. the index and   */
+/*        the counts are then kept up to date by move_cells()            */
+/* ********************************************************************** */
+void circuit::init_legality()
+{
+	legal_lines.clear();
+	legal_line_at.clear();
+	vector<unsigned> rowOrder(rows.size());
+	for(unsigned r=0 ; r<rows.size() ; r++)
+		rowOrder[r] = r;
+	sort(rowOrder.begin(), rowOrder.end(), [this](unsigned a, unsigned b) { return rows[a] < rows[b]; });
+	for(unsigned r=0 ; r<rowOrder.size() ; r++)
+	{
+		int y = rows[ rowOrder[r] ].origY;
+		if(legal_line_at.find(y) == legal_line_at.end())
 		{
-			log << "ILLEGAL TYPE 5 : node " << currCell->name <<" overlaps with node " << nextCell->name <<". ";
-			log << "(" << currCell->x_coord << " to "<< currCell->x_coord+currCell->width << ", "<< currCell->y_coord << "), (" << nextCell->x_coord <<", "<< nextCell->y_coord << ")" << endl;
-			error_type_5++;
+			legal_line_at[y] = legal_lines.size();
+			legal_lines.push_back(legality_line());
+			legal_lines.back().y = y;
 		}
+		legal_lines[ legal_line_at[y] ].rows.push_back(rowOrder[r]);
 	}
-	cout << error_type_5 <<endl;
 
-  // ILLEGAL_TYPE 6: is a movable node placed within the row sites?          
-	unsigned error_type_6=0;
-	row_index=0;
-	cout << "  Testing ILLEGAL_TYPE 6 .. ";
-	for(vector<cell>::iterator theCell=cells.begin() ; theCell != cells.end() ; ++theCell)
+	legal_counts.assign(6, 0);
+	legal_flags.assign(cells.size(), 0);
+	for(unsigned i=0 ; i<cells.size() ; i++)
+		add_cell_legality(i, cell_x[i], cell_y[i], 1);
+	return;
+}
+
+/* ********************************************************************* */
+/*  Desc: the ILLEGAL_TYPE 1, 2, 3, 4 & 6 violations of cell c at (x,y) */
+/*        (bit k for TYPE k+1), same rules as check_row_legality         */
+/* ********************************************************************* */
+unsigned char circuit::cell_legal_flags(unsigned c, int x, int y)
+{
+	cell *theCell=&cells[c];
+	if(theCell->isFixed)
+		return (x != theCell->init_x_coord || y != theCell->init_y_coord) ? 1 : 0;
+
+	unsigned char flags = (theCell->cellorient != "N") ? 2 : 0;
+	map<int, unsigned>::iterator it = legal_line_at.find(y);
+	if(it == legal_line_at.end() || legal_lines[it->second].rows.empty())
+		return flags | 4 | 8 | 32;
+
+	/* the last row starting at or left of x, else the leftmost one */
+	const vector<unsigned> &lineRows = legal_lines[it->second].rows;
+	unsigned lo = 0, hi = lineRows.size();
+	while(hi - lo > 1)
 	{
-		if(theCell->isFixed)
-			continue;
+		unsigned mid = (lo + hi)/2;
+		if(rows[ lineRows[mid] ].origX <= x)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	row *theRow = &rows[ lineRows[lo] ];
+	if(x < theRow->origX || x+theCell->width > theRow->origX + theRow->numSites * theRow->stepX)
+		flags |= 8;
+	if(x < theRow->origX || (x - theRow->origX) % theRow->stepX != 0)
+		flags |= 32;
+	return flags;
+}
+
+/* ILLEGAL_TYPE 5 is counted between neighbours in (x, id) order, as in check_row_legality */
+bool circuit::slices_overlap(const pair<int, unsigned> &left, const pair<int, unsigned> &right)
+{
+	return left.first + llround(cells[left.second].width) > right.first;
+}
+
+/* ********************************************************************** */
+/*  Desc: add (sign 1) or remove (sign -1) cell c at (x,y) to/from the    */
+/*        line index & the violation counts. O(log n) per row it spans;  */
+/*        a slice off the rows gets a line of its own, as in            */
+/*        legality_by_rows                                               */
+/* ********************************************************************** */
+void circuit::add_cell_legality(unsigned c, int x, int y, int sign)
+{
+	unsigned char flags = (sign > 0) ? cell_legal_flags(c, x, y) : legal_flags[c];
+	for(unsigned k=0 ; k<6 ; k++)
+		if(flags & (1 << k))
+			legal_counts[k] += sign;
+	legal_flags[c] = (sign > 0) ? flags : 0;
 
-		for( ; row_index<rows.size() ; row_index++)
+	for(int slice_y = y ; slice_y == y || slice_y < y + cells[c].height ; slice_y += (int)rowHeight)
+	{
+		map<int, unsigned>::iterator it = legal_line_at.find(slice_y);
+		if(it == legal_line_at.end())
 		{
-			row *theRow=&rows[row_index];
-			if(theCell->y_coord > theRow->origY)
-				continue;
+			/* a line with no rows, for the overlaps off the rows */
+			it = legal_line_at.insert(make_pair(slice_y, legal_lines.size())).first;
+			legal_lines.push_back(legality_line());
+			legal_lines.back().y = slice_y;
+		}
+		set< pair<int, unsigned> > &slices = legal_lines[it->second].slices;
+		pair<int, unsigned> theSlice(x, c);
+		set< pair<int, unsigned> >::iterator next, prev;
+		if(sign > 0)
+			next = slices.insert(theSlice).first;
+		else
+			next = slices.find(theSlice);
+		assert(next != slices.end());
+		prev = next;
+		++next;
 
-			bool site_aligned = false;
-			while(theCell->y_coord == theRow->origY)
-			{
-				if(theCell->x_coord >= theRow->origX)
-				{
-					if(theCell->x_coord == theRow->origX + int((theCell->x_coord - theRow->origX)/theRow->stepX) * theRow->stepX)
-					{
-						site_aligned = true;
-						break;
-					}
-					break;
-				}
-				row_index++;
-				if(row_index > rows.size()-1)
-					break;
-				theRow = &rows[row_index];
-			}
-			if(!site_aligned)
-			{
-				log << "ILLEGAL TYPE 6 : Movable node " << theCell->name <<" is not aligned to a row site. ";
-				log << "(" << theCell->x_coord << ", "<< theCell->y_coord << ")" << endl;
-				error_type_6++;
-			}
-			break;
+		int delta = 0;
+		if(prev != slices.begin())
+		{
+			--prev;
+			delta += slices_overlap(*prev, theSlice);
+			if(next != slices.end())
+				delta += slices_overlap(theSlice, *next) - slices_overlap(*prev, *next);
 		}
+		else if(next != slices.end())
+			delta += slices_overlap(theSlice, *next);
+		legal_counts[4] += sign*delta;
+		if(sign < 0)
+			slices.erase(theSlice);
 	}
-	cout << error_type_6 <<endl;
+	return;
+}
 
-	log.close();
-	if((error_type_1+error_type_2+error_type_3+error_type_4+error_type_5+error_type_6) == 0)
+/* *********************************************************************** */
+/*  Desc: the violations cell c would take part in if moved to (x,y), the  */
+/*        other cells staying in place; 0 if the move keeps c legal.       */
+/*        overlaps are found from the neighbours at x on each row spanned, */
+/*        exact as long as the rest of that row is overlap-free. needs     */
+/*        init_legality(), O(log n) per row spanned                        */
+/* *********************************************************************** */
+unsigned circuit::move_violations(unsigned c, int x, int y)
+{
+	assert(!legal_counts.empty());
+	unsigned violations = 0;
+	unsigned char flags = cell_legal_flags(c, x, y);
+	for(unsigned k=0 ; k<6 ; k++)
+		if(flags & (1 << k))
+			violations++;
+
+	for(int slice_y = y ; slice_y == y || slice_y < y + cells[c].height ; slice_y += (int)rowHeight)
 	{
-		system("rm check_legality.log");
-		return true;
+		map<int, unsigned>::iterator it = legal_line_at.find(slice_y);
+		if(it == legal_line_at.end())
+			continue;
+		set< pair<int, unsigned> > &slices = legal_lines[it->second].slices;
+		pair<int, unsigned> theSlice(x, c);
+		set< pair<int, unsigned> >::iterator next = slices.lower_bound(theSlice), prev = next;
+		while(next != slices.end() && next->second == c)
+			++next;
+		if(next != slices.end() && slices_overlap(theSlice, *next))
+			violations++;
+		while(prev != slices.begin())
+		{
+			--prev;
+			if(prev->second == c)
+				continue;
+			if(slices_overlap(*prev, theSlice))
+				violations++;
+			break;
+		}
 	}
-	return false;
+	return violations;
 }
-
@@ -11,6 +11,13 @@
 #include "evaluate.h"
 #include "Flute/flute.h"
 
+// NOTE: the vectorized kernels (update_pinlocs, measure_HPWL) are picked at
+// run time, so the binary still runs on machines without AVX2
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && !defined(NO_AVX2)
+#define EVALUATE_AVX2
+#include <immintrin.h>
+#endif
+
 /* ******************************************************* */
 /*  Desc: measure timing (TNS, WNS) of the given circuit   */
 /* ******************************************************* */
@@ -20,7 +27,6 @@ bool circuit::measure_timing()
   build_steiner();
   slice_longwires(MAX_WIRE_SEGMENT_IN_MICRON * static_cast<double>(DEFdist2Microns));
 
-  map<string, double> pincap;              /* map from pin name -> cap */
   ofstream netlist("feed.netlist");
 	stringstream feed;
 	feed.precision(5);
@@ -30,11 +36,7 @@ bool circuit::measure_timing()
 	for(vector<unsigned>::iterator PI=PIs.begin() ; PI!=PIs.end() ; ++PI)
 		feed << "input " << pins[ *PI ].name <<endl;
 	for(vector<unsigned>::iterator PO=POs.begin() ; PO!=POs.end() ; ++PO)
-	{
 		feed << "output " << pins[ *PO ].name <<endl;
-		// load capacitances at outputs
-		pincap[ pins[ *PO ].name ] = pins[ *PO ].cap;
-	}
 
 	// 1.a writing input driver specs
 	for(vector<unsigned>::iterator PI=PIs.begin() ; PI!=PIs.end() ; ++PI)
@@ -44,12 +46,12 @@ bool circuit::measure_timing()
 
 		int driver=pins[ *PI ].driverType;
 		feed << "instance " << macros[driver].name;
-		for(map<string, macro_pin>::iterator theMacPin = macros[driver].pins.begin() ; theMacPin != macros[driver].pins.end() ; ++theMacPin)
+		for(vector<macro_pin>::iterator theMacPin = macros[driver].pins.begin() ; theMacPin != macros[driver].pins.end() ; ++theMacPin)
 		{
-			if((theMacPin->second).direction == "INPUT")
-				feed << " " << theMacPin->first << ":" << pins[ *PI ].name + "_drvin";
-			else if((theMacPin->second).direction == "OUTPUT")
-				feed << " " << theMacPin->first << ":" << pins[ *PI ].name + "_drvout";
+			if(theMacPin->direction == "INPUT")
+				feed << " " << theMacPin->name << ":" << pins[ *PI ].name + "_drvin";
+			else if(theMacPin->direction == "OUTPUT")
+				feed << " " << theMacPin->name << ":" << pins[ *PI ].name + "_drvout";
 		}
 		feed << endl;
 	}
@@ -59,40 +61,23 @@ bool circuit::measure_timing()
   {
 		if(theCell->ports.size() == 0)
 			continue;
-    feed << "instance " << macros[theCell->type].name;
-    for(map<string, unsigned>::iterator thePort = theCell->ports.begin() ; thePort != theCell->ports.end() ; ++thePort)
+    macro *theMacro = &macros[theCell->type];
+    feed << "instance " << theMacro->name;
+    for(unsigned port = 0 ; port < theCell->ports.size() ; ++port)
 		{
-			if(pins[ thePort->second ].type == PI_PIN && pins[ thePort->second ].name != clock_port)
-			  feed << " " << thePort->first << ":" << pins[ thePort->second ].name + "_drvout";
+			unsigned thePin = theCell->ports[port];
+			if(thePin == numeric_limits<unsigned>::max())
+				continue;
+			if(pins[ thePin ].type == PI_PIN && pins[ thePin ].name != clock_port)
+			  feed << " " << theMacro->pins[port].name << ":" << pins[ thePin ].name + "_drvout";
 			else
-				feed << " " << thePort->first << ":" << pins[ thePort->second ].name;
+				feed << " " << theMacro->pins[port].name << ":" << pins[ thePin ].name;
 		}
 		feed <<endl;
   }
 
   // 2. writing wire specs
-  map<string, bool> cap_written;
-  // 2.a. adding up pin caps from wires (PI model)
-  for(vector<net>::iterator theNet = nets.begin() ; theNet != nets.end() ; ++theNet)
-    for(vector< pair< pair<string, string>, double > >::iterator theSeg=theNet->wire_segs.begin();
-        theSeg != theNet->wire_segs.end() ; ++theSeg)
-    {
-			assert(theNet->name.length() < MAX_PIN_NAME_LENGTH);
-			if(theNet->name == clock_port)
-			{
-				pincap [ theSeg->first.first ] += theSeg->second  / static_cast<double>(DEFdist2Microns) * GLOBAL_WIRE_CAP_PER_MICRON * 0.5;
-				pincap [ theSeg->first.second ] += theSeg->second / static_cast<double>(DEFdist2Microns) * GLOBAL_WIRE_CAP_PER_MICRON * 0.5;
-			}
-			else
-			{
-				pincap [ theSeg->first.first ] += theSeg->second  / static_cast<double>(DEFdist2Microns) * LOCAL_WIRE_CAP_PER_MICRON * 0.5;
-				pincap [ theSeg->first.second ] += theSeg->second / static_cast<double>(DEFdist2Microns) * LOCAL_WIRE_CAP_PER_MICRON * 0.5;
-			}
-      cap_written [ theSeg->first.first ] = false;
-      cap_written [ theSeg->first.second ] = false;
-    }
-
-	// 2.b. zero-resistance wires between PIs and input drivers
+	// 2.a. zero-resistance wires between PIs and input drivers
 	for(vector<unsigned>::iterator PI=PIs.begin() ; PI!=PIs.end() ; ++PI)
 	{
 		if(pins[ *PI ].name == clock_port)
@@ -100,40 +85,60 @@ bool circuit::measure_timing()
 		feed << "wire " << pins[ *PI ].name << " " << pins[ *PI ].name+"_drvin" <<endl;
 		feed << "  res " << pins[ *PI ].name << " " << pins[ *PI ].name+"_drvin "<< 0.0 <<endl;
 	}	
-  // 2.c. write wire specs (PI-model)
+  // 2.b. write wire specs (PI-model), net by net
+	vector<double> nodecap;        /* cap of each wire node of the net */
+	vector<bool> cap_written;
+	vector<string> nodename;       /* names of the wire nodes, made on first use */
   for(vector<net>::iterator theNet = nets.begin() ; theNet != nets.end() ; ++theNet)
   {
+		double cap_per_micron = (theNet->name == clock_port) ? GLOBAL_WIRE_CAP_PER_MICRON : LOCAL_WIRE_CAP_PER_MICRON;
+		double res_per_micron = (theNet->name == clock_port) ? GLOBAL_WIRE_RES_PER_MICRON : LOCAL_WIRE_RES_PER_MICRON;
+		assert(theNet->wire_segs.empty() || theNet->name.length() < MAX_PIN_NAME_LENGTH);
+
+		// adding up node caps from wires (PI model), on top of the load capacitances at outputs
+		unsigned numNodes = theNet->wire_nodes.size();
+		nodecap.assign(numNodes, 0.0);
+		cap_written.assign(numNodes, false);
+		nodename.assign(numNodes, string());
+		for(unsigned i=0 ; i<numNodes ; i++)
+			if(theNet->wire_nodes[i].type == PIN_NODE && pins[ theNet->wire_nodes[i].id ].type == PO_PIN)
+				nodecap[i] = pins[ theNet->wire_nodes[i].id ].cap;
+    for(wire_seg_list::iterator theSeg=theNet->wire_segs.begin() ; theSeg != theNet->wire_segs.end() ; ++theSeg)
+		{
+			nodecap[ theSeg->from ] += theSeg->length / static_cast<double>(DEFdist2Microns) * cap_per_micron * 0.5;
+			nodecap[ theSeg->to ]   += theSeg->length / static_cast<double>(DEFdist2Microns) * cap_per_micron * 0.5;
+		}
+
 		if(pins[ theNet->source ].type == PI_PIN && pins[ theNet->source ].name != clock_port)
 			feed << "wire "<< pins[ theNet->source ].name + "_drvout";
 		else
 			feed << "wire "<< pins[ theNet->source ].name;
 		assert(theNet->sinks.size() < MAX_WIRE_TAPS);
-    for(vector<unsigned>::iterator theSink = theNet->sinks.begin() ; theSink != theNet->sinks.end() ; ++theSink)
+    for(id_list::iterator theSink = theNet->sinks.begin() ; theSink != theNet->sinks.end() ; ++theSink)
       feed << " " << pins[ *theSink ].name;
     feed << endl;
 
 		assert(theNet->wire_segs.size() < MAX_INTERNAL_NODES + MAX_WIRE_TAPS);
-    for(vector< pair< pair<string, string>, double > >::iterator theSeg=theNet->wire_segs.begin() ; 
-        theSeg != theNet->wire_segs.end() ; ++theSeg)
+    for(wire_seg_list::iterator theSeg=theNet->wire_segs.begin() ; theSeg != theNet->wire_segs.end() ; ++theSeg)
     {
-      if(!cap_written[theSeg->first.first])
+			if(nodename[ theSeg->from ].empty())
+				nodename[ theSeg->from ] = wire_node_name(*theNet, theSeg->from);
+			if(nodename[ theSeg->to ].empty())
+				nodename[ theSeg->to ] = wire_node_name(*theNet, theSeg->to);
+
+      if(!cap_written[ theSeg->from ])
       {
-        feed << "	cap " << theSeg->first.first << " " << pincap[ theSeg->first.first ]<<endl;
-        cap_written[theSeg->first.first] = true;
+        feed << "	cap " << nodename[ theSeg->from ] << " " << nodecap[ theSeg->from ]<<endl;
+        cap_written[ theSeg->from ] = true;
       }
-			if(theNet->name == clock_port)
-      	feed << "	res " << theSeg->first.first << " " << theSeg->first.second << " " << theSeg->second / static_cast<double>(DEFdist2Microns) * GLOBAL_WIRE_RES_PER_MICRON <<endl;
-			else
-      	feed << "	res " << theSeg->first.first << " " << theSeg->first.second << " " << theSeg->second / static_cast<double>(DEFdist2Microns) * LOCAL_WIRE_RES_PER_MICRON <<endl;
-      if(!cap_written[theSeg->first.second])
+     	feed << "	res " << nodename[ theSeg->from ] << " " << nodename[ theSeg->to ] << " " << theSeg->length / static_cast<double>(DEFdist2Microns) * res_per_micron <<endl;
+      if(!cap_written[ theSeg->to ])
       {
-        feed << "	cap " << theSeg->first.second << " " << pincap[ theSeg->first.second ]<<endl;
-        cap_written[theSeg->first.second] = true;
+        feed << "	cap " << nodename[ theSeg->to ] << " " << nodecap[ theSeg->to ]<<endl;
+        cap_written[ theSeg->to ] = true;
       }
     }
   }
-  cap_written.clear();
-  pincap.clear();
 	
 	// 3 writing clock period
 	feed << "clock "<< clock_port << " " << clock_period <<endl;
@@ -213,22 +218,63 @@ bool circuit::measure_timing()
   return true;
 }
 
+#ifdef EVALUATE_AVX2
+/* ************************************************************************* */
+/*  Desc: AVX2 body of update_pinlocs(), four pins at a time                 */
+/*        gathers the owner cell locations & adds the pin offsets; lanes of  */
+/*        pins without an owner keep their own location. returns the number  */
+/*        of pins handled, the remainder is left to the scalar loop          */
+/* ************************************************************************* */
+__attribute__((target("avx2")))
+static unsigned update_pinlocs_avx2(unsigned numPins, const unsigned* owner, const int* cell_x, const int* cell_y,
+		const double* xoff, const double* yoff, double* x, double* y)
+{
+	const __m128i none = _mm_set1_epi32(-1);
+	unsigned i=0;
+	for( ; i+4 <= numPins ; i+=4)
+	{
+		__m128i theOwner = _mm_loadu_si128((const __m128i*)(owner+i));
+		__m128i owned    = _mm_xor_si128(_mm_cmpeq_epi32(theOwner, none), none);
+		__m256d ownedPd  = _mm256_castsi256_pd(_mm256_cvtepi32_epi64(owned));
+
+		__m128i cx = _mm_mask_i32gather_epi32(_mm_setzero_si128(), cell_x, theOwner, owned, 4);
+		__m128i cy = _mm_mask_i32gather_epi32(_mm_setzero_si128(), cell_y, theOwner, owned, 4);
+		__m256d bx = _mm256_blendv_pd(_mm256_loadu_pd(x+i), _mm256_cvtepi32_pd(cx), ownedPd);
+		__m256d by = _mm256_blendv_pd(_mm256_loadu_pd(y+i), _mm256_cvtepi32_pd(cy), ownedPd);
+		_mm256_storeu_pd(x+i, _mm256_add_pd(bx, _mm256_loadu_pd(xoff+i)));
+		_mm256_storeu_pd(y+i, _mm256_add_pd(by, _mm256_loadu_pd(yoff+i)));
+	}
+	return i;
+}
+#endif
+
 /* ************************************************************************* */
 /*  Desc: update pin locations based on owner cell locations & pin offsets   */
 /* ************************************************************************* */
 void circuit::update_pinlocs()
 {
-	for(vector<pin>::iterator thePin = pins.begin() ; thePin != pins.end() ; ++thePin)
+	// NOTE: only PIs/POs can be fixed pins, and they have no owner cell
+	unsigned numPins = pins.size();
+	if(numPins == 0)
+		return;
+
+	const unsigned* owner = pin_owner.data();
+	unsigned i=0;
+#ifdef EVALUATE_AVX2
+	if(__builtin_cpu_supports("avx2"))
+		i = update_pinlocs_avx2(numPins, owner, cell_x.data(), cell_y.data(), pin_xoff.data(), pin_yoff.data(), pin_x.data(), pin_y.data());
+#endif
+	for( ; i<numPins ; i++)
 	{
-		if(thePin->isFixed || thePin->owner == numeric_limits<unsigned>::max())
+		if(owner[i] == numeric_limits<unsigned>::max())
 		{
-			thePin->x_coord = thePin->x_coord + thePin->x_offset;
-			thePin->y_coord = thePin->y_coord + thePin->y_offset;
+			pin_x[i] = pin_x[i] + pin_xoff[i];
+			pin_y[i] = pin_y[i] + pin_yoff[i];
 		}
 		else
 		{
-			thePin->x_coord = cells[ thePin->owner ].x_coord + thePin->x_offset;
-			thePin->y_coord = cells[ thePin->owner ].y_coord + thePin->y_offset;
+			pin_x[i] = cell_x[ owner[i] ] + pin_xoff[i];
+			pin_y[i] = cell_y[ owner[i] ] + pin_yoff[i];
 		}
 	}
   return;
@@ -247,45 +293,48 @@ void circuit::build_steiner()
 
   for(vector<net>::iterator theNet = nets.begin() ; theNet != nets.end() ; ++theNet)
   {
-    // clear theNet->wire_segs before population
+    // clear theNet->wire_nodes & wire_segs before population
+    theNet->wire_nodes.clear();
     theNet->wire_segs.clear();
     unsigned numpins=theNet->sinks.size()+1; 
+		if(numpins < 2)
+			continue;
+
+		// node 0 is the source (or the driver output of a PI), nodes 1.. are the sinks
+		if(pins[ theNet->source ].type == PI_PIN && pins[ theNet->source ].name != clock_port)
+			theNet->wire_nodes.push_back( wire_node(DRVOUT_NODE, theNet->source) );
+		else
+			theNet->wire_nodes.push_back( wire_node(PIN_NODE, theNet->source) );
+		for(id_list::iterator theSink=theNet->sinks.begin() ; theSink != theNet->sinks.end() ; ++theSink)
+			theNet->wire_nodes.push_back( wire_node(PIN_NODE, *theSink) );
 
     // two pin nets
     if(numpins==2)
     {
-      double wirelength = fabs(pins[ theNet->source ].x_coord - pins[ theNet->sinks[0] ].x_coord) +
-        fabs(pins[ theNet->source ].y_coord - pins[ theNet->sinks[0] ].y_coord);
+      double wirelength = fabs(pin_x[ theNet->source ] - pin_x[ theNet->sinks[0] ]) +
+        fabs(pin_y[ theNet->source ] - pin_y[ theNet->sinks[0] ]);
       total_StWL += wirelength;
-
-			if(pins[ theNet->source ].type == PI_PIN && pins[ theNet->source ].name != clock_port)
-				theNet->wire_segs.push_back( make_pair (make_pair(pins[ theNet->source ].name+"_drvout", pins[ theNet->sinks[0] ].name), wirelength) );
-			else
-				theNet->wire_segs.push_back( make_pair (make_pair(pins[ theNet->source ].name, pins[ theNet->sinks[0] ].name), wirelength) );
+			theNet->wire_segs.push_back( wire_seg(0, 1, wirelength) );
     }
 
     // otherwise, let's build a FLUTE tree
-    else if(numpins > 2)
+    else
     {
-			map< pair<string, string>, bool> pinpair_covered;
+			map< pair<unsigned, unsigned>, bool> pinpair_covered;
       unsigned *x = new unsigned[numpins];
       unsigned *y = new unsigned[numpins];
 
-      map< pair<unsigned, unsigned>, string > pinmap;  // pinmap : map from pair< x location, y location> to pinName 
-      x[0]=(unsigned)(max(pins[ theNet->source ].x_coord, 0.0));
-      y[0]=(unsigned)(max(pins[ theNet->source ].y_coord, 0.0));
-      pinmap[ make_pair(x[0], y[0]) ] = pins[ theNet->source ].name;
-			if(pins[ theNet->source ].type == PI_PIN && pins[ theNet->source ].name != clock_port)
-				pinmap[ make_pair(x[0], y[0]) ] = pins[ theNet->source ].name+"_drvout";
-			else
-				pinmap[ make_pair(x[0], y[0]) ] = pins[ theNet->source ].name;
+      map< pair<unsigned, unsigned>, unsigned > pinmap;  // pinmap : map from pair< x location, y location> to node 
+      x[0]=(unsigned)(max(pin_x[ theNet->source ], 0.0));
+      y[0]=(unsigned)(max(pin_y[ theNet->source ], 0.0));
+      pinmap[ make_pair(x[0], y[0]) ] = 0;
 
       unsigned j=1;
-      for(vector<unsigned>::iterator theSink=theNet->sinks.begin() ; theSink != theNet->sinks.end() ; ++theSink, j++)
+      for(id_list::iterator theSink=theNet->sinks.begin() ; theSink != theNet->sinks.end() ; ++theSink, j++)
       {
-        x[j]=(unsigned)(max(pins[ *theSink ].x_coord, 0.0));
-        y[j]=(unsigned)(max(pins[ *theSink ].y_coord, 0.0));
-        pinmap[ make_pair(x[j], y[j]) ] = pins[ *theSink ].name;
+        x[j]=(unsigned)(max(pin_x[ *theSink ], 0.0));
+        y[j]=(unsigned)(max(pin_y[ *theSink ], 0.0));
+        pinmap[ make_pair(x[j], y[j]) ] = j;
       }
       Tree flutetree = flute(numpins, x, y, ACCURACY);
       delete [] x;
@@ -303,44 +352,51 @@ void circuit::build_steiner()
 				total_StWL += wirelength;
 				if(theNet->name == "iccad_clk")
 					max_clk_StWL = max(max_clk_StWL, wirelength);
-				// any internal Steiner points will have blank names, so assign them to sp_<counter>
-				string pin1=pinmap[ make_pair(flutetree.branch[j].x, flutetree.branch[j].y) ]; 
-				if(pin1 == "")
+				// any internal Steiner points are not in pinmap, so add them as sp_<counter> nodes
+				map< pair<unsigned, unsigned>, unsigned >::iterator it = pinmap.find( make_pair(flutetree.branch[j].x, flutetree.branch[j].y) );
+				unsigned pin1, pin2;
+				if(it == pinmap.end())
 				{
 					steiner_points_cnt++;
-					pin1="sp_"+to_string(static_cast<long long unsigned>(steiner_points_cnt));
-					pinmap[ make_pair(flutetree.branch[j].x, flutetree.branch[j].y) ] = pin1;					
+					pin1 = theNet->wire_nodes.size();
+					theNet->wire_nodes.push_back( wire_node(STEINER_NODE, steiner_points_cnt) );
+					pinmap[ make_pair(flutetree.branch[j].x, flutetree.branch[j].y) ] = pin1;
 				}
-				string pin2=pinmap[ make_pair(flutetree.branch[n].x, flutetree.branch[n].y) ]; 
-				if(pin2 == "")
+				else
+					pin1 = it->second;
+				it = pinmap.find( make_pair(flutetree.branch[n].x, flutetree.branch[n].y) );
+				if(it == pinmap.end())
 				{
 					steiner_points_cnt++;
-					pin2="sp_"+to_string(static_cast<long long unsigned>(steiner_points_cnt));
-					pinmap[ make_pair(flutetree.branch[n].x, flutetree.branch[n].y) ] = pin2;					
+					pin2 = theNet->wire_nodes.size();
+					theNet->wire_nodes.push_back( wire_node(STEINER_NODE, steiner_points_cnt) );
+					pinmap[ make_pair(flutetree.branch[n].x, flutetree.branch[n].y) ] = pin2;
 				}
+				else
+					pin2 = it->second;
 				if(pin1 == pin2) // NOTE: this only happens when two pin locations are the same (i.e., critically stacked)
 				{
-					for(vector<unsigned>::iterator theSink2=theNet->sinks.begin() ; theSink2 != theNet->sinks.end() ; ++theSink2)
+					for(unsigned k=1 ; k<numpins ; k++)
 					{
-						if(pins[ *theSink2 ].name == pin1)
+						if(k == pin1)
 							continue;
-						unsigned x=(unsigned)(max(pins[ *theSink2 ].x_coord, 0.0));
-						unsigned y=(unsigned)(max(pins[ *theSink2 ].y_coord, 0.0));
+						unsigned x=(unsigned)(max(pin_x[ theNet->sinks[k-1] ], 0.0));
+						unsigned y=(unsigned)(max(pin_y[ theNet->sinks[k-1] ], 0.0));
 						if(flutetree.branch[j].x == x && flutetree.branch[j].y == y)
 						{
-							if(pinpair_covered[ make_pair(pin1, pins[ *theSink2 ].name) ])
+							if(pinpair_covered[ make_pair(pin1, k) ])
 								continue;
 							else
 							{
-								// find another pin's name
-								pin2 = pins[ *theSink2 ].name;
+								// find another pin
+								pin2 = k;
 								break;
 							}
 						}
 					}
 				}
 				if(pin1 != pin2)
-				theNet->wire_segs.push_back( make_pair( make_pair(pin1, pin2), wirelength ) );
+				theNet->wire_segs.push_back( wire_seg(pin1, pin2, wirelength) );
 				pinpair_covered[ make_pair(pin1, pin2) ]=true;
       }
 			pinpair_covered.clear();
@@ -353,8 +409,8 @@ void circuit::build_steiner()
 
 #ifdef DEBUG
   for(vector<net>::iterator theNet=nets.begin() ; theNet != nets.end() ; ++theNet)
-    for(vector< pair< pair<string, string>, double > >::iterator theSeg=theNet->wire_segs.begin() ; theSeg != theNet->wire_segs.end() ; theSeg++)
-			cout << theSeg->first.first << ", "<< theSeg->first.second << " - "<< theSeg->second <<endl;
+    for(wire_seg_list::iterator theSeg=theNet->wire_segs.begin() ; theSeg != theNet->wire_segs.end() ; theSeg++)
+			cout << wire_node_name(*theNet, theSeg->from) << ", "<< wire_node_name(*theNet, theSeg->to) << " - "<< theSeg->length <<endl;
 #endif
 
 	cout << "  Longest clock wire segment : "<< max_clk_StWL/static_cast<double>(DEFdist2Microns) << " um" <<endl;
@@ -376,30 +432,30 @@ void circuit::slice_longwires(unsigned threshold)
 		org_tot_wire_segments+=orig_wire_seg_cnt;
 		for(unsigned i=0 ; i<orig_wire_seg_cnt ; i++)
     {
-			pair< pair<string, string>, double > *theSeg = &theNet->wire_segs[i];
+			wire_seg *theSeg = &theNet->wire_segs[i];
       // if the length of this wire segment is longer than the threshold, 
       // let's slice it equally and add proper nodes
-      if(theSeg->second  > threshold)
+      if(theSeg->length  > threshold)
       {
-        string end_pin_name1=theSeg->first.first;
-        string end_pin_name2=theSeg->first.second;
-        unsigned slice_cnt = ceil(theSeg->second/(double)threshold);
-        double sliced_wirelength=theSeg->second/(double)slice_cnt;
-
-        string prev_pin_name=end_pin_name1+"_"+end_pin_name2+"_0";
-//				if(prev_pin_name.length() >= MAX_PIN_NAME_LENGTH)
-//					cout << prev_pin_name.length() <<endl;
-				assert(prev_pin_name.length() < MAX_PIN_NAME_LENGTH);
-        theSeg->first.second=prev_pin_name;
-        theSeg->second=sliced_wirelength;
+        unsigned end_node1=theSeg->from;
+        unsigned end_node2=theSeg->to;
+        unsigned slice_cnt = ceil(theSeg->length/(double)threshold);
+        double sliced_wirelength=theSeg->length/(double)slice_cnt;
+        unsigned prev_node=theNet->wire_nodes.size();
+        theNet->wire_nodes.push_back( wire_node(SLICE_NODE, 0, end_node1, end_node2) );
+        theSeg->to=prev_node;
+        theSeg->length=sliced_wirelength;
         for(unsigned j=1 ; j<slice_cnt ; j++, tot_slice_cnt++)
         {
-          string cur_pin_name=end_pin_name1+"_"+end_pin_name2+"_"+to_string(static_cast<long long unsigned>(j));
-					assert(cur_pin_name.length() < MAX_PIN_NAME_LENGTH);
-          theNet->wire_segs.push_back( make_pair( make_pair(prev_pin_name, cur_pin_name), sliced_wirelength ) );
-					prev_pin_name = cur_pin_name;
+          unsigned cur_node=end_node2;
+          if(j < slice_cnt-1)
+          {
+            cur_node=theNet->wire_nodes.size();
+            theNet->wire_nodes.push_back( wire_node(SLICE_NODE, j, end_node1, end_node2) );
+          }
+          theNet->wire_segs.push_back( wire_seg(prev_node, cur_node, sliced_wirelength) );
+					prev_node = cur_node;
         }
-        theNet->wire_segs[ theNet->wire_segs.size()-1 ].first.second=end_pin_name2;
       }
     }
     tot_wire_segments += theNet->wire_segs.size();
@@ -408,35 +464,71 @@ void circuit::slice_longwires(unsigned threshold)
   return;
 }
 
+/* ************************************************************** */
+/*  Desc: name of a wire node, as written to the timer netlist    */
+/*        slices of a segment are named <end1>_<end2>_<slice no.> */
+/* ************************************************************** */
+string circuit::wire_node_name(const net &theNet, unsigned node)
+{
+	const wire_node &theNode = theNet.wire_nodes[node];
+	switch(theNode.type)
+	{
+		case PIN_NODE:
+			return pins[ theNode.id ].name;
+		case DRVOUT_NODE:
+			return pins[ theNode.id ].name + "_drvout";
+		case STEINER_NODE:
+			return "sp_"+to_string(static_cast<long long unsigned>(theNode.id));
+		default:
+		{
+			assert(theNode.type == SLICE_NODE);
+			string name = wire_node_name(theNet, theNode.end1)+"_"+wire_node_name(theNet, theNode.end2)+"_"+to_string(static_cast<long long unsigned>(theNode.id));
+			assert(name.length() < MAX_PIN_NAME_LENGTH);
+			return name;
+		}
+	}
+}
+
 /* ************************************************************* */
 /*  Desc: measure max cell displacement from an input placement  */
 /* ************************************************************* */
 void circuit::measure_displacement()
 {
 	displacement=0.0;
-	for(vector<cell>::iterator theCell=cells.begin() ; theCell!=cells.end() ; ++theCell)
-		if(!theCell->isFixed)
-	    displacement=max(displacement, fabs(theCell->init_x_coord - theCell->x_coord) + fabs(theCell->init_y_coord - theCell->y_coord));
+	for(unsigned i=0 ; i<cells.size() ; i++)
+		if(!cells[i].isFixed)
+	    displacement=max(displacement, fabs(cells[i].init_x_coord - cell_x[i]) + fabs(cells[i].init_y_coord - cell_y[i]));
 	
 	displacement /= static_cast<double>(DEFdist2Microns);
 	return;
 }
 
-/* *************************************** */
-/*  Desc: measure ABU and density penalty  */
-/* *************************************** */
-void circuit::measure_ABU(double unit, double targUt)
+/* ************************************************************************ */
+/*  Desc: set up a x_gridNum x y_gridNum density map of gridUnit bins, add   */
+/*        the row sites to free_space & the cell areas to f_util/m_util     */
+/* ************************************************************************ */
+void circuit::build_density_bins(vector<density_bin> &bins, double gridUnit, int x_gridNum, int y_gridNum)
 {
-  double gridUnit = unit * rowHeight;
-  int x_gridNum = (int) ceil ((rx - lx)/gridUnit);
-  int y_gridNum = (int) ceil ((ty - by)/gridUnit);
-  int numBins = x_gridNum*y_gridNum;
-
-  cout << "  numBins         : "<<numBins << " ( "<< x_gridNum << " x "<< y_gridNum << " )"<< endl;
-  cout << "  bin dimension   : "<< gridUnit << " x " << gridUnit <<endl;
+	vector<long long> area;
+	init_density_bins(bins, gridUnit, x_gridNum, y_gridNum);
+	sum_density_areas(bins, gridUnit, x_gridNum, y_gridNum, area);
+	for(unsigned binId=0 ; binId<bins.size() ; binId++)
+	{
+		bins[binId].free_space = min((double)area[3*binId], bins[binId].area);
+		bins[binId].f_util = area[3*binId+1];
+		bins[binId].m_util = area[3*binId+2];
+	}
+	return;
+}
 
+/* ******************************************************************* */
+/*  Desc: set up the bins of a x_gridNum x y_gridNum density map with  */
+/*        gridUnit bins, all empty                                     */
+/* ******************************************************************* */
+void circuit::init_density_bins(vector<density_bin> &bins, double gridUnit, int x_gridNum, int y_gridNum)
+{
   /* 0. initialize density map */
-  vector<density_bin> bins(numBins);
+  bins.resize(x_gridNum*y_gridNum);
   for(int j=0;j<y_gridNum;j++)
     for(int k=0;k<x_gridNum;k++)
     {
@@ -454,65 +546,202 @@ void circuit::measure_ABU(double unit, double targUt)
       bins[binId].f_util=0.0;
       bins[binId].free_space=0.0;
     }
+	return;
+}
+
+/* ******************************************************************** */
+/*  Desc: the edges of a density map's bins, rounded to DBU; all cell  */
+/*        & row areas are summed up against these                      */
+/* ******************************************************************** */
+void circuit::density_edges(const vector<density_bin> &bins, int x_gridNum, int y_gridNum, 
+		vector<long long> &xEdge, vector<long long> &yEdge)
+{
+  xEdge.resize(x_gridNum+1);
+  yEdge.resize(y_gridNum+1);
+  for(int k=0;k<x_gridNum;k++)
+    xEdge[k] = llround(bins[k].lx);
+  for(int j=0;j<y_gridNum;j++)
+    yEdge[j] = llround(bins[j*x_gridNum].ly);
+  xEdge[x_gridNum] = llround(rx);
+  yEdge[y_gridNum] = llround(ty);
+	return;
+}
 
+/* ************************************************************************* */
+/*  Desc: row site (not clamped to the bin area), fixed & movable area of  */
+/*        each bin, as 3 entries per bin in area                           */
+/* ************************************************************************* */
+void circuit::sum_density_areas(const vector<density_bin> &bins, double gridUnit, int x_gridNum, int y_gridNum, 
+		vector<long long> &area)
+{
   /* 1. build density map */
-	/* (a) calculate overlaps with row sites, and add them to free_space */
-	for(vector<row>::iterator theRow=rows.begin() ; theRow != rows.end() ; ++theRow)
+  // NOTE: areas are summed up in DBU, so the result does not depend on the number of threads
+  int numBins = x_gridNum*y_gridNum;
+  vector<long long> xEdge, yEdge;
+  density_edges(bins, x_gridNum, y_gridNum, xEdge, yEdge);
+
+  /* (a) & (b) each thread adds a share of the rows & cells to its own grid of */
+  /*     free_space, f_util & m_util (3 per bin)                             */
+	unsigned numThreads = max(1u, thread::hardware_concurrency());
+	numThreads = min(numThreads, (unsigned)((rows.size() + cells.size()) / (1 << 14)) + 1);
+	vector< vector<long long> > acc(numThreads);
+	auto accumulate = [&](unsigned t) {
+		acc[t].assign(3*numBins, 0);
+		for(unsigned r = rows.size()*t/numThreads ; r < rows.size()*(t+1)/numThreads ; r++)
+			add_rect_to_grid(acc[t].data(), 0, xEdge, yEdge, lx, by, gridUnit, 
+					rows[r].origX, rows[r].origY, 
+					rows[r].origX + (long long)rows[r].numSites*rows[r].stepX, rows[r].origY + llround(rowHeight));
+		for(unsigned i = cells.size()*t/numThreads ; i < cells.size()*(t+1)/numThreads ; i++)
+			add_rect_to_grid(acc[t].data(), cells[i].isFixed ? 1 : 2, xEdge, yEdge, lx, by, gridUnit, 
+					cell_x[i], cell_y[i], cell_x[i] + llround(cells[i].width), cell_y[i] + llround(cells[i].height));
+	};
+	run_threads(numThreads, accumulate);
+
+	area.swap(acc[0]);
+	for(unsigned t=1 ; t<numThreads ; t++)
+		for(int i=0 ; i<3*numBins ; i++)
+			area[i] += acc[t][i];
+	return;
+}
+
+/* ********************************************************************** */
+/*  Desc: call add(binId, overlap) for each bin that [x1,x2) x [y1,y2)    */
+/*        overlaps, the overlap in DBU^2 against the rounded bin edges   */
+/* ********************************************************************** */
+template <class F>
+static inline void for_rect_bins(const vector<long long> &xEdge, const vector<long long> &yEdge, 
+		double gridLx, double gridBy, double gridUnit, long long x1, long long y1, long long x2, long long y2, F add)
+{
+	int x_gridNum = xEdge.size()-1, y_gridNum = yEdge.size()-1;
+  int lcol=max((int)floor((x1-gridLx)/gridUnit), 0);
+  int rcol=min((int)floor((x2-gridLx)/gridUnit), x_gridNum-1);
+  int brow=max((int)floor((y1-gridBy)/gridUnit), 0);
+  int trow=min((int)floor((y2-gridBy)/gridUnit), y_gridNum-1);
+
+  for(int j=brow;j<=trow;j++)
 	{
- 	 	int lcol=max((int)floor((theRow->origX - lx)/gridUnit), 0);
-    int rcol=min((int)floor((theRow->origX + theRow->numSites*theRow->stepX - lx)/gridUnit), x_gridNum-1);
-    int brow=max((int)floor((theRow->origY - by)/gridUnit), 0);
-    int trow=min((int)floor((theRow->origY + rowHeight - by)/gridUnit), y_gridNum-1);
+		long long h = min(yEdge[j+1], y2) - max(yEdge[j], y1);
+		if(h <= 0)
+			continue;
+    for(int k=lcol;k<=rcol;k++)
+    {
+			long long w = min(xEdge[k+1], x2) - max(xEdge[k], x1);
+			if(w > 0)
+				add(j*x_gridNum+k, w*h);
+		}
+	}
+	return;
+}
 
-    for(int j=brow;j<=trow;j++)
-      for(int k=lcol;k<=rcol;k++)
-      {
-        unsigned binId= j*x_gridNum+k;
+/* ************************************************************************ */
+/*  Desc: add the overlap of [x1,x2) x [y1,y2) with each bin to slot of the */
+/*        bin in grid (3 slots per bin); bin edges are given in DBU        */
+/* ************************************************************************ */
+void add_rect_to_grid(long long* grid, unsigned slot, const vector<long long> &xEdge, const vector<long long> &yEdge, 
+		double gridLx, double gridBy, double gridUnit, long long x1, long long y1, long long x2, long long y2)
+{
+	for_rect_bins(xEdge, yEdge, gridLx, gridBy, gridUnit, x1, y1, x2, y2, [grid, slot](unsigned binId, long long area) {
+		grid[3*binId+slot] += area; });
+	return;
+}
+
+/* ********************************************************************* */
+/*  Desc: add (sign=1.0) or remove (sign=-1.0) the area of cell i placed */
+/*        at (x, y) to/from the bins it overlaps, in whole DBU^2 as in   */
+/*        sum_density_areas, so that the map does not drift from a      */
+/*        fresh build                                                    */
+/* ********************************************************************* */
+void circuit::add_cell_to_bins(vector<density_bin> &bins, const vector<long long> &xEdge, const vector<long long> &yEdge, 
+		double gridUnit, unsigned i, int x, int y, double sign)
+{
+  cell *theCell=&cells[i];
+	double density_bin::*util = theCell->isFixed ? &density_bin::f_util : &density_bin::m_util;
+	for_rect_bins(xEdge, yEdge, lx, by, gridUnit, x, y, x + llround(theCell->width), y + llround(theCell->height), 
+			[&bins, util, sign](unsigned binId, long long area) {
+		bins[binId].*util += sign * area; });
+	return;
+}
 
-        /* get intersection */
-        double lx=max(bins[binId].lx, (double)theRow->origX);
-        double hx=min(bins[binId].hx, (double)theRow->origX + theRow->numSites*theRow->stepX);
-        double ly=max(bins[binId].ly, (double)theRow->origY);
-        double hy=min(bins[binId].hy, (double)theRow->origY + rowHeight);
+/* *********************************************************************** */
+/*  Desc: utilization of a bin whose free_space excludes the fixed area;   */
+/*        bins too small or with too little free space get 0. skipped is   */
+/*        set for the latter, which are not counted in the ABU             */
+/* *********************************************************************** */
+static inline double bin_utilization(const density_bin &bin, double gridUnit, bool &skipped)
+{
+	skipped = false;
+	if(bin.area <= gridUnit*gridUnit*BIN_AREA_THRESHOLD)
+		return 0.0;
+	if(bin.free_space > FREE_SPACE_THRESHOLD*bin.area)
+		return bin.m_util / bin.free_space;
+	skipped = true;
+	return 0.0;
+}
 
-        if((hx-lx) > 1.0e-5 && (hy-ly) > 1.0e-5)
-        {
-          double common_area = (hx-lx) * (hy-ly);
-          bins[binId].free_space+= common_area;
-					bins[binId].free_space = min(bins[binId].free_space, bins[binId].area);
-        }
-      }
-	}
+/* ************************************************************************ */
+/*  Desc: ABU_2,5,10,20 & ABU_penalty from the largest bin utilizations,   */
+/*        sorted in ascending order. top must hold at least the top 20% of */
+/*        the numCounted (=non-skipped) bins, and at least one             */
+/* ************************************************************************ */
+double circuit::ABU_from_top(const vector<double> &top, int numCounted, double targUt, bool verbose)
+{
+  int last = top.size()-1;
+  const double ratio[5] = { 0.01, 0.02, 0.05, 0.10, 0.20 };
+  double abu[5];
 
-  /* (b) add utilization by fixed/movable objects */
-  for(vector<cell>::iterator theCell=cells.begin() ; theCell != cells.end() ; ++theCell)
+  /* 3. obtain ABU numbers */
+  for(unsigned r=0 ; r<5 ; r++)
   {
-    int lcol=max((int)floor((theCell->x_coord-lx)/gridUnit), 0);
-    int rcol=min((int)floor((theCell->x_coord+theCell->width-lx)/gridUnit), x_gridNum-1);
-    int brow=max((int)floor((theCell->y_coord-by)/gridUnit), 0);
-    int trow=min((int)floor((theCell->y_coord+theCell->height-by)/gridUnit), y_gridNum-1);
+    int clip_index = ratio[r]*numCounted;
+    assert(clip_index <= last+1);
+    abu[r]=0.0;
+    for(int j=last;j>last-clip_index;j--) {
+      abu[r]+=top[j];
+    }
+    abu[r]=(clip_index) ? abu[r]/clip_index : top[last];
+  }
 
-    for(int j=brow;j<=trow;j++)
-      for(int k=lcol;k<=rcol;k++)
-      {
-        unsigned binId= j*x_gridNum+k;
+  if(verbose)
+  {
+    cout << "  target util     : "<< targUt <<endl;
+    cout << "  ABU_2,5,10,20   : "<< abu[1] <<", "<< abu[2] <<", "<< abu[3] <<", "<< abu[4] <<endl;
+  }
 
-        /* get intersection */
-        double lx=max(bins[binId].lx, (double)theCell->x_coord);
-        double hx=min(bins[binId].hx, (double)theCell->x_coord+theCell->width);
-        double ly=max(bins[binId].ly, (double)theCell->y_coord);
-        double hy=min(bins[binId].hy, (double)theCell->y_coord+theCell->height);
+  /* calculate overflow & ABU_penalty */
+  for(unsigned r=0 ; r<5 ; r++)
+    abu[r]=max(0.0, abu[r]/targUt-1.0);
+  return (ABU2_WGT*abu[1]+ABU5_WGT*abu[2]+ABU10_WGT*abu[3]+ABU20_WGT*abu[4])/(double)(ABU2_WGT+ABU5_WGT+ABU10_WGT+ABU20_WGT);
+}
 
-        if((hx-lx) > 1.0e-5 && (hy-ly) > 1.0e-5)
-        {
-          double common_area = (hx-lx) * (hy-ly);
-          if(theCell->isFixed)
-            bins[binId].f_util+=common_area;
-          else 
-            bins[binId].m_util+=common_area;
-        }
-      }
-  }
+/* ********************************************************************** */
+/*  Desc: ABU_penalty from all bin utilizations. only the top 20% of the  */
+/*        bins are sorted, after a selection (reorders util_array)        */
+/* ********************************************************************** */
+double circuit::ABU_from_utils(vector<double> &util_array, int skipped_bin_cnt, double targUt, bool verbose)
+{
+  int numBins = util_array.size();
+  int numTop = max((int)(0.20*(numBins-skipped_bin_cnt)), 1);
+  nth_element(util_array.begin(), util_array.end()-numTop, util_array.end());
+  vector<double> top(util_array.end()-numTop, util_array.end());
+  sort(top.begin(), top.end());
+  return ABU_from_top(top, numBins-skipped_bin_cnt, targUt, verbose);
+}
+
+/* *************************************** */
+/*  Desc: measure ABU and density penalty  */
+/* *************************************** */
+void circuit::measure_ABU(double unit, double targUt)
+{
+  double gridUnit = unit * rowHeight;
+  int x_gridNum = (int) ceil ((rx - lx)/gridUnit);
+  int y_gridNum = (int) ceil ((ty - by)/gridUnit);
+  int numBins = x_gridNum*y_gridNum;
+
+  cout << "  numBins         : "<<numBins << " ( "<< x_gridNum << " x "<< y_gridNum << " )"<< endl;
+  cout << "  bin dimension   : "<< gridUnit << " x " << gridUnit <<endl;
+
+  vector<density_bin> bins;
+  build_density_bins(bins, gridUnit, x_gridNum, y_gridNum);
 
   int skipped_bin_cnt=0;
   vector<double> util_array(numBins, 0.0);
@@ -521,156 +750,1235 @@ void circuit::measure_ABU(double unit, double targUt)
     for(int k=0;k<x_gridNum;k++)
     {
       unsigned binId= j*x_gridNum+k;
+      bool skipped;
       if(bins[binId].area > gridUnit*gridUnit*BIN_AREA_THRESHOLD)
-      {
         bins[binId].free_space-= bins[binId].f_util;
-        if(bins[binId].free_space > FREE_SPACE_THRESHOLD*bins[binId].area)
-          util_array[binId] = bins[binId].m_util / bins[binId].free_space;
-        else
-          skipped_bin_cnt++;
+      util_array[binId] = bin_utilization(bins[binId], gridUnit, skipped);
+      if(skipped)
+        skipped_bin_cnt++;
 #ifdef DEBUG
-        if(util_array[binId] > 1.0)
-        {
-          cout << binId  << " is not legal. "<< endl;
-          cout << " m_util: " << bins[binId].m_util << " f_util " << bins[binId].f_util << " free_space: " << bins[binId].free_space<< endl;
-          exit(1);
-        }
-#endif
+      if(util_array[binId] > 1.0)
+      {
+        cout << binId  << " is not legal. "<< endl;
+        cout << " m_util: " << bins[binId].m_util << " f_util " << bins[binId].f_util << " free_space: " << bins[binId].free_space<< endl;
+        exit(1);
       }
+#endif
     }
 
-// Plot --------------------------------------------------------------------
-	ofstream plotfile;
-	// Plot a the utilization map.
-	plotfile.open("grid.plt");
-    
-	plotfile << "set term png\n";
-	plotfile << "set output \"grid.png\"\n";
-	plotfile << "set autoscale fix\n";
-	plotfile << "\n";
-	plotfile << 
-		"set palette defined ( 0 '#000090',\\\n"
-		"                      1 '#000fff',\\\n"
-		"                      2 '#0090ff',\\\n"
-		"                      3 '#0fffee',\\\n"
-		"                      4 '#90ff70',\\\n"
-		"                      5 '#ffee00',\\\n"
-		"                      6 '#ff7000',\\\n"
-		"                      7 '#ee0000',\\\n"
-		"                      8 '#7f0000')\n\n"
-	;
-	
-	plotfile << "plot '-' matrix with image t ''\n";
+  if(plot_format != PLOT_NONE)
+    start_density_plot(util_array, bins, x_gridNum, y_gridNum);
+  bins.clear();
+  ABU_penalty = ABU_from_utils(util_array, skipped_bin_cnt, targUt, true);
+  return;
+}
 
-	for (int j = 0; j < y_gridNum; j++) {
-		for (int k = 0; k < x_gridNum; k++) {
-			const unsigned binId = j*x_gridNum+k;
-			plotfile << util_array[binId] << " ";
-		} // end for
-		plotfile << "\n";
-	} // end for
-
-	plotfile.close();
-
-	// Plot a binary map of utilized bins.
-	plotfile.open("circuit.plt");
-    
-	plotfile << "set term png\n";
-	plotfile << "set output \"circuit.png\"\n";
-	plotfile << "set autoscale fix\n";
-	plotfile << "\n";
-	plotfile << "set palette defined ( 0 0 0 0, 1 1 1 1 )\n";
-	plotfile << "\n";
-	
-	plotfile << "plot '-' matrix with image t ''\n";
+/* ************************************************************************ */
+/*  Desc: build a density map that is kept up to date by move_cells, so the  */
+/*        ABU of a candidate placement does not need a full rebuild. same    */
+/*        bins & utilizations as measure_ABU                                 */
+/* ************************************************************************ */
+void circuit::init_density(double unit, double targUt)
+{
+	density_unit = unit * rowHeight;
+	density_targUt = targUt;
+  density_xnum = (int) ceil ((rx - lx)/density_unit);
+  density_ynum = (int) ceil ((ty - by)/density_unit);
+	build_density_bins(density_bins, density_unit, density_xnum, density_ynum);
+	density_edges(density_bins, density_xnum, density_ynum, density_xEdge, density_yEdge);
+	top_utils.clear();
+	rest_utils.clear();
+	top_size = 0;
+
+	bin_util.resize(density_bins.size());
+	density_skipped = 0;
+	for(unsigned binId=0 ; binId<density_bins.size() ; binId++)
+	{
+		bool skipped;
+		if(density_bins[binId].area > density_unit*density_unit*BIN_AREA_THRESHOLD)
+			density_bins[binId].free_space-= density_bins[binId].f_util;
+		bin_util[binId] = bin_utilization(density_bins[binId], density_unit, skipped);
+		if(skipped)
+			density_skipped++;
+	}
+	ABU_penalty = density_ABU();
+	return;
+}
+
+/* ********************************************************************** */
+/*  Desc: move the area of cell c from (oldX, oldY) to its current place  */
+/*        & refresh the utilization of the touched bins only             */
+/* ********************************************************************** */
+void circuit::move_cell_density(unsigned c, int oldX, int oldY)
+{
+	// NOTE: fixed cells would change the free space & the set of skipped bins
+	assert(!cells[c].isFixed);
+	add_cell_to_bins(density_bins, density_xEdge, density_yEdge, density_unit, c, oldX, oldY, -1.0);
+	add_cell_to_bins(density_bins, density_xEdge, density_yEdge, density_unit, c, cell_x[c], cell_y[c], 1.0);
+
+	for(unsigned pass=0 ; pass<2 ; pass++)
+	{
+		int x = pass ? cell_x[c] : oldX, y = pass ? cell_y[c] : oldY;
+		int lcol=max((int)floor((x-lx)/density_unit), 0);
+		int rcol=min((int)floor((x+llround(cells[c].width)-lx)/density_unit), density_xnum-1);
+		int brow=max((int)floor((y-by)/density_unit), 0);
+		int trow=min((int)floor((y+llround(cells[c].height)-by)/density_unit), density_ynum-1);
+		for(int j=brow;j<=trow;j++)
+			for(int k=lcol;k<=rcol;k++)
+			{
+				bool skipped;
+				unsigned binId= j*density_xnum+k;
+				double util = bin_utilization(density_bins[binId], density_unit, skipped);
+				if(top_size != 0 && util != bin_util[binId])
+					update_top_utils(bin_util[binId], util);
+				bin_util[binId] = util;
+			}
+	}
+	return;
+}
+
+/* ********************************************************************** */
+/*  Desc: keep the top 20% of the bin utilizations in a sorted set while  */
+/*        cells move, so that density_ABU does not scan all the bins      */
+/* ********************************************************************** */
+void circuit::init_top_utils()
+{
+	assert(!density_bins.empty());
+	vector<double> util_array(bin_util);
+	top_size = max((int)(0.20*(util_array.size()-density_skipped)), 1);
+	nth_element(util_array.begin(), util_array.end()-top_size, util_array.end());
+	top_utils = multiset<double>(util_array.end()-top_size, util_array.end());
+	rest_utils = multiset<double>(util_array.begin(), util_array.end()-top_size);
+	return;
+}
+
+/* **************************************************************** */
+/*  Desc: replace one bin utilization in the top/rest sets & move   */
+/*        the boundary value so that top keeps the largest ones     */
+/* **************************************************************** */
+void circuit::update_top_utils(double oldUtil, double newUtil)
+{
+	// NOTE: equal values are interchangeable, so either set may give up oldUtil
+	multiset<double>::iterator it = top_utils.find(oldUtil);
+	if(it != top_utils.end())
+		top_utils.erase(it);
+	else
+		rest_utils.erase(rest_utils.find(oldUtil));
+
+	if(top_utils.size() < top_size)
+	{
+		if(!rest_utils.empty() && *rest_utils.rbegin() > newUtil)
+		{
+			it = --rest_utils.end();
+			top_utils.insert(*it);
+			rest_utils.erase(it);
+			rest_utils.insert(newUtil);
+		}
+		else
+			top_utils.insert(newUtil);
+	}
+	else if(newUtil > *top_utils.begin())
+	{
+		rest_utils.insert(*top_utils.begin());
+		top_utils.erase(top_utils.begin());
+		top_utils.insert(newUtil);
+	}
+	else
+		rest_utils.insert(newUtil);
+	return;
+}
+
+/* ******************************************************************** */
+/*  Desc: ABU_penalty of the density map built by init_density, at the  */
+/*        current cell locations                                        */
+/* ******************************************************************** */
+double circuit::density_ABU()
+{
+	assert(!density_bins.empty());
+	int numCounted = density_bins.size()-density_skipped;
+	if(top_size != 0)
+	{
+		vector<double> top(top_utils.begin(), top_utils.end());
+		ABU_penalty = ABU_from_top(top, numCounted, density_targUt, false);
+	}
+	else
+	{
+		vector<double> util_array(bin_util);
+		ABU_penalty = ABU_from_utils(util_array, density_skipped, density_targUt, false);
+	}
+	return ABU_penalty;
+}
+
+/* ************************************************************************ */
+/*  Desc: summed-area tables of the site, fixed & movable area over a base  */
+/*        grid of unit x unit row heights, for window_density. with         */
+/*        fenwick, the movable area is kept in a Fenwick tree instead, so   */
+/*        that cell moves cost O(log^2); otherwise moves are queued &      */
+/*        folded into the table in one pass once ~sqrt(bins) are pending    */
+/* ************************************************************************ */
+void circuit::init_density_sat(double unit, bool fenwick)
+{
+  double gridUnit = unit * rowHeight;
+  int x_gridNum = (int) ceil ((rx - lx)/gridUnit);
+  int y_gridNum = (int) ceil ((ty - by)/gridUnit);
+	vector<density_bin> bins;
+	build_density_bins(bins, gridUnit, x_gridNum, y_gridNum);
+	sat_unit = gridUnit;
+
+	density_edges(bins, x_gridNum, y_gridNum, sat_xEdge, sat_yEdge);
+
+	/* bin (k, j) goes to entry (k+1, j+1); row & column 0 stay empty */
+	unsigned stride = x_gridNum+1;
+	sat_site.assign(stride*(y_gridNum+1), 0);
+	sat_fixed.assign(stride*(y_gridNum+1), 0);
+	sat_movable.assign(stride*(y_gridNum+1), 0);
+  for(int j=0;j<y_gridNum;j++)
+    for(int k=0;k<x_gridNum;k++)
+    {
+      unsigned binId= j*x_gridNum+k, entry= (j+1)*stride+k+1;
+			sat_site[entry] = llround(bins[binId].free_space);
+			sat_fixed[entry] = llround(bins[binId].f_util);
+			sat_movable[entry] = llround(bins[binId].m_util);
+		}
+
+	sat_fenwick = fenwick;
+	sat_pending.clear();
+	sat_pending_max = max(64, (int)sqrt((double)x_gridNum*y_gridNum));
+	vector<long long>* tables[3] = { &sat_site, &sat_fixed, &sat_movable };
+	for(unsigned t=0 ; t<3 ; t++)
+	{
+		vector<long long> &table = *tables[t];
+		if(t == 2 && fenwick)
+		{
+			// NOTE: a 2-D Fenwick tree is built in linear time, one dimension at a time
+			for(int j=1;j<=y_gridNum;j++)
+				for(int k=1;k<=x_gridNum;k++)
+					if(k + (k & -k) <= x_gridNum)
+						table[j*stride + k + (k & -k)] += table[j*stride + k];
+			for(int j=1;j<=y_gridNum;j++)
+				if(j + (j & -j) <= y_gridNum)
+					for(int k=1;k<=x_gridNum;k++)
+						table[(j + (j & -j))*stride + k] += table[j*stride + k];
+			continue;
+		}
+		for(int j=1;j<=y_gridNum;j++)
+			for(int k=1;k<=x_gridNum;k++)
+				table[j*stride+k] += table[(j-1)*stride+k] + table[j*stride+k-1] - table[(j-1)*stride+k-1];
+	}
+	return;
+}
+
+/* *************************************************************** */
+/*  Desc: total of the base bins [0,i) x [0,j) in a table          */
+/* *************************************************************** */
+long long circuit::sat_prefix(const vector<long long> &table, bool fenwick, int i, int j)
+{
+	unsigned stride = sat_xEdge.size();
+	if(!fenwick)
+		return table[j*stride+i];
+	long long sum=0;
+	for(int y=j ; y>0 ; y -= y & -y)
+		for(int x=i ; x>0 ; x -= x & -x)
+			sum += table[y*stride+x];
+	return sum;
+}
+
+/* ********************************************************************** */
+/*  Desc: base bin i holding coordinate x, & the fraction f of the bin    */
+/*        left of x; all bins are unit wide except the last one           */
+/* ********************************************************************** */
+static inline void sat_locate(const vector<long long> &edge, double unit, double x, int &i, double &f)
+{
+	int num = edge.size()-1;
+	x = max((double)edge[0], min(x, (double)edge[num]));
+	i = min((int)((x - edge[0]) / unit), num-1);
+	// NOTE: the bin edges are rounded to DBU, so the guess may be one bin off
+	if(i > 0 && x < edge[i])
+		i--;
+	else if(i < num-1 && x >= edge[i+1])
+		i++;
+	f = (x - edge[i]) / (edge[i+1] - edge[i]);
+	return;
+}
+
+/* ************************************************************************ */
+/*  Desc: total of a table below & left of a point inside base bin (i, j), */
+/*        fx/fy into the bin, taking the bin's area as spread evenly       */
+/* ************************************************************************ */
+double circuit::sat_corner(const vector<long long> &table, bool fenwick, int i, int j, double fx, double fy)
+{
+	long long p00 = sat_prefix(table, fenwick, i, j), p10 = sat_prefix(table, fenwick, i+1, j);
+	long long p01 = sat_prefix(table, fenwick, i, j+1), p11 = sat_prefix(table, fenwick, i+1, j+1);
+	return p00 + fx*(p10-p00) + fy*(p01-p00) + fx*fy*(double)(p11-p10-p01+p00);
+}
+
+/* ****************************************************************** */
+/*  Desc: share of base bin k inside a window from bin i1 (fraction    */
+/*        f1 in) to bin i2 (fraction f2 in)                           */
+/* ****************************************************************** */
+static inline double sat_share(int k, int i1, double f1, int i2, double f2)
+{
+	if(k < i1 || k > i2)
+		return 0.0;
+	return (k == i2 ? f2 : 1.0) - (k == i1 ? f1 : 0.0);
+}
 
-	for (int j = 0; j < y_gridNum; j++) {
-		for (int k = 0; k < x_gridNum; k++) {
-			const unsigned binId = j*x_gridNum+k;
-			if ( bins[binId].f_util > 0 )
-				plotfile << 0 << " ";
+/* ************************************************************************* */
+/*  Desc: movable, fixed & free area in the window [x1,x2) x [y1,y2) (DBU) */
+/*        in O(1) (plus the pending moves); exact for windows on base bin  */
+/*        edges                                                             */
+/* ************************************************************************* */
+density_window circuit::window_density(double x1, double y1, double x2, double y2)
+{
+	assert(!sat_movable.empty());
+	int i1, i2, j1, j2;
+	double fx1, fx2, fy1, fy2;
+	sat_locate(sat_xEdge, sat_unit, x1, i1, fx1);
+	sat_locate(sat_xEdge, sat_unit, x2, i2, fx2);
+	sat_locate(sat_yEdge, sat_unit, y1, j1, fy1);
+	sat_locate(sat_yEdge, sat_unit, y2, j2, fy2);
+
+	density_window window;
+	vector<long long>* tables[3] = { &sat_movable, &sat_fixed, &sat_site };
+	double area[3];
+	for(unsigned t=0 ; t<3 ; t++)
+	{
+		bool fenwick = (t == 0 && sat_fenwick);
+		area[t] = sat_corner(*tables[t], fenwick, i2, j2, fx2, fy2) - sat_corner(*tables[t], fenwick, i1, j2, fx1, fy2)
+		        - sat_corner(*tables[t], fenwick, i2, j1, fx2, fy1) + sat_corner(*tables[t], fenwick, i1, j1, fx1, fy1);
+	}
+	// NOTE: a pending move's area is spread evenly over its bin, as in sat_corner
+	unsigned stride = sat_xEdge.size();
+	for(unsigned p=0 ; p<sat_pending.size() ; p++)
+	{
+		int k = sat_pending[p].first % stride - 1, j = sat_pending[p].first / stride - 1;
+		area[0] += sat_pending[p].second * sat_share(k, i1, fx1, i2, fx2) * sat_share(j, j1, fy1, j2, fy2);
+	}
+	window.movable = area[0];
+	window.fixed = area[1];
+	window.free_space = area[2] - area[1];
+	return window;
+}
+
+/* ********************************************************************** */
+/*  Desc: add (sign=1) or remove (sign=-1) the area of movable cell c     */
+/*        placed at (x, y) to/from the movable table                      */
+/* ********************************************************************** */
+void circuit::add_cell_sat(unsigned c, int x, int y, long long sign)
+{
+	assert(!cells[c].isFixed);
+	int x_gridNum = sat_xEdge.size()-1, y_gridNum = sat_yEdge.size()-1;
+	unsigned stride = x_gridNum+1;
+	long long x2 = x + llround(cells[c].width), y2 = y + llround(cells[c].height);
+	int lcol = max((int)(upper_bound(sat_xEdge.begin(), sat_xEdge.end(), (long long)x) - sat_xEdge.begin()) - 1, 0);
+	int brow = max((int)(upper_bound(sat_yEdge.begin(), sat_yEdge.end(), (long long)y) - sat_yEdge.begin()) - 1, 0);
+
+	for(int j=brow ; j<y_gridNum && sat_yEdge[j]<y2 ; j++)
+	{
+		long long h = min(sat_yEdge[j+1], y2) - max(sat_yEdge[j], (long long)y);
+		if(h <= 0)
+			continue;
+		for(int k=lcol ; k<x_gridNum && sat_xEdge[k]<x2 ; k++)
+		{
+			long long w = min(sat_xEdge[k+1], x2) - max(sat_xEdge[k], (long long)x);
+			if(w <= 0)
+				continue;
+			if(sat_fenwick)
+			{
+				for(int jj=j+1 ; jj<=y_gridNum ; jj += jj & -jj)
+					for(int kk=k+1 ; kk<=x_gridNum ; kk += kk & -kk)
+						sat_movable[jj*stride+kk] += sign*w*h;
+			}
 			else
-				plotfile << 1 << " ";
-		} // end for
+				sat_pending.push_back(make_pair((j+1)*stride+k+1, sign*w*h));
+		}
+	}
+	if(sat_pending.size() > sat_pending_max)
+		flush_sat_pending();
+	return;
+}
+
+/* ******************************************************************* */
+/*  Desc: fold the pending moves into the movable summed-area table,   */
+/*        one prefix sum over the grid for all of them                 */
+/* ******************************************************************* */
+void circuit::flush_sat_pending()
+{
+	int x_gridNum = sat_xEdge.size()-1, y_gridNum = sat_yEdge.size()-1;
+	unsigned stride = x_gridNum+1;
+	vector<long long> delta(sat_movable.size(), 0);
+	for(unsigned p=0 ; p<sat_pending.size() ; p++)
+		delta[ sat_pending[p].first ] += sat_pending[p].second;
+	sat_pending.clear();
+
+	for(int j=1;j<=y_gridNum;j++)
+		for(int k=1;k<=x_gridNum;k++)
+		{
+			delta[j*stride+k] += delta[(j-1)*stride+k] + delta[j*stride+k-1] - delta[(j-1)*stride+k-1];
+			sat_movable[j*stride+k] += delta[j*stride+k];
+		}
+	return;
+}
+
+/* ************************************************************************ */
+/*  Desc: ABU_penalty for several bin sizes (in row heights) at the cost of */
+/*        one density map: the areas are summed up once on a one row height */
+/*        grid, & each bin size adds up blocks of those bins. same results  */
+/*        as measure_ABU for each size                                      */
+/* ************************************************************************ */
+vector<double> circuit::measure_ABU_pyramid(const vector<unsigned> &bin_dims, double targUt)
+{
+  int base_xNum = (int) ceil ((rx - lx)/rowHeight);
+  int base_yNum = (int) ceil ((ty - by)/rowHeight);
+	vector<density_bin> bins;
+	vector<long long> baseArea;
+	init_density_bins(bins, rowHeight, base_xNum, base_yNum);
+	sum_density_areas(bins, rowHeight, base_xNum, base_yNum, baseArea);
+
+	vector<double> penalties;
+	for(vector<unsigned>::const_iterator theDim=bin_dims.begin() ; theDim != bin_dims.end() ; ++theDim)
+	{
+		unsigned f = *theDim;
+		double gridUnit = f * rowHeight;
+		int x_gridNum = (int) ceil ((rx - lx)/gridUnit);
+		int y_gridNum = (int) ceil ((ty - by)/gridUnit);
+		cout << "  bin dimension   : "<< gridUnit << " x " << gridUnit << " ( "<< x_gridNum << " x "<< y_gridNum << " bins )"<< endl;
+
+		/* add up the base bins of each bin */
+		init_density_bins(bins, gridUnit, x_gridNum, y_gridNum);
+		vector<long long> area(3*bins.size(), 0);
+		for(int j=0;j<base_yNum;j++)
+			for(int k=0;k<base_xNum;k++)
+			{
+				unsigned baseId= j*base_xNum+k, binId= min(j/(int)f, y_gridNum-1)*x_gridNum + min(k/(int)f, x_gridNum-1);
+				for(unsigned s=0 ; s<3 ; s++)
+					area[3*binId+s] += baseArea[3*baseId+s];
+			}
+
+		int skipped_bin_cnt=0;
+		vector<double> util_array(bins.size(), 0.0);
+		for(unsigned binId=0 ; binId<bins.size() ; binId++)
+		{
+			bool skipped;
+			bins[binId].free_space = min((double)area[3*binId], bins[binId].area);
+			bins[binId].f_util = area[3*binId+1];
+			bins[binId].m_util = area[3*binId+2];
+			if(bins[binId].area > gridUnit*gridUnit*BIN_AREA_THRESHOLD)
+				bins[binId].free_space-= bins[binId].f_util;
+			util_array[binId] = bin_utilization(bins[binId], gridUnit, skipped);
+			if(skipped)
+				skipped_bin_cnt++;
+		}
+		penalties.push_back(ABU_from_utils(util_array, skipped_bin_cnt, targUt, true));
+		cout << "  ABU penalty     : "<< penalties.back() <<endl;
+	}
+	return penalties;
+}
+
+/* ********************************************************************** */
+/*  Desc: write one frame of the density map: the utilization of each     */
+/*        bin, & (first frame only) which bins hold fixed cells           */
+/* ********************************************************************** */
+static void write_density_plot(unsigned format, string name, vector<double> util, vector<unsigned char> fixedBins, 
+		int x_gridNum, int y_gridNum)
+{
+	/* same palette as the gnuplot output, over utilizations 0 .. 1 */
+	static const unsigned char palette[9][3] = { 
+		{0x00,0x00,0x90}, {0x00,0x0f,0xff}, {0x00,0x90,0xff}, {0x0f,0xff,0xee}, {0x90,0xff,0x70},
+		{0xff,0xee,0x00}, {0xff,0x70,0x00}, {0xee,0x00,0x00}, {0x7f,0x00,0x00} };
+
+	ofstream plotfile;
+	if(format == PLOT_GNUPLOT)
+	{
+		plotfile.open((name + ".plt").c_str());
+		plotfile << "set term png\n";
+		plotfile << "set output \"" << name << ".png\"\n";
+		plotfile << "set autoscale fix\n";
 		plotfile << "\n";
-	} // end for
-	plotfile.close();
-  // -------------------------------------------------------------------------
-  bins.clear();
-  sort(util_array.begin(), util_array.end());
+		plotfile << 
+			"set palette defined ( 0 '#000090',\\\n"
+			"                      1 '#000fff',\\\n"
+			"                      2 '#0090ff',\\\n"
+			"                      3 '#0fffee',\\\n"
+			"                      4 '#90ff70',\\\n"
+			"                      5 '#ffee00',\\\n"
+			"                      6 '#ff7000',\\\n"
+			"                      7 '#ee0000',\\\n"
+			"                      8 '#7f0000')\n\n"
+		;
+		plotfile << "plot '-' matrix with image t ''\n";
+		for (int j = 0; j < y_gridNum; j++) {
+			for (int k = 0; k < x_gridNum; k++)
+				plotfile << util[j*x_gridNum+k] << " ";
+			plotfile << "\n";
+		}
+		plotfile.close();
+	}
+	else if(format == PLOT_PPM)
+	{
+		// NOTE: images start at the top, so the rows are written from the top of the die
+		vector<unsigned char> pixels(3*x_gridNum*y_gridNum);
+		for (int j = 0; j < y_gridNum; j++)
+			for (int k = 0; k < x_gridNum; k++)
+			{
+				double u = 8.0 * max(0.0, min(util[j*x_gridNum+k], 1.0));
+				int lo = min((int)u, 7);
+				double frac = u - lo;
+				unsigned char* pixel = &pixels[3*((y_gridNum-1-j)*x_gridNum+k)];
+				for(unsigned c=0 ; c<3 ; c++)
+					pixel[c] = (unsigned char)(palette[lo][c] + frac*(palette[lo+1][c] - palette[lo][c]) + 0.5);
+			}
+		plotfile.open((name + ".ppm").c_str(), ios::binary);
+		plotfile << "P6\n" << x_gridNum << " " << y_gridNum << "\n255\n";
+		plotfile.write((const char*)pixels.data(), pixels.size());
+		plotfile.close();
+	}
+	else
+	{
+		vector<float> values(util.begin(), util.end());
+		plotfile.open((name + ".f32").c_str(), ios::binary);
+		plotfile.write((const char*)values.data(), values.size()*sizeof(float));
+		plotfile.close();
+	}
 
-  /* 3. obtain ABU numbers */
-  double abu1=0.0, abu2=0.0, abu5=0.0, abu10=0.0, abu20=0.0;
-  int clip_index = 0.01*(numBins-skipped_bin_cnt);
-  for(int j=numBins-1;j>numBins-1-clip_index;j--) {
-    abu1+=util_array[j];
-  }
-  abu1=(clip_index) ? abu1/clip_index : util_array[numBins-1];
+	if(fixedBins.empty())
+		return;
+	/* binary map of the bins with fixed cells (black) */
+	string fixedName = name.substr(0, name.find_last_of('_')) + "_fixed";
+	if(format == PLOT_GNUPLOT)
+	{
+		plotfile.open((fixedName + ".plt").c_str());
+		plotfile << "set term png\n";
+		plotfile << "set output \"" << fixedName << ".png\"\n";
+		plotfile << "set autoscale fix\n";
+		plotfile << "\n";
+		plotfile << "set palette defined ( 0 0 0 0, 1 1 1 1 )\n";
+		plotfile << "\n";
+		plotfile << "plot '-' matrix with image t ''\n";
+		for (int j = 0; j < y_gridNum; j++) {
+			for (int k = 0; k < x_gridNum; k++)
+				plotfile << (fixedBins[j*x_gridNum+k] ? 0 : 1) << " ";
+			plotfile << "\n";
+		}
+		plotfile.close();
+	}
+	else
+	{
+		vector<unsigned char> pixels(x_gridNum*y_gridNum);
+		for (int j = 0; j < y_gridNum; j++)
+			for (int k = 0; k < x_gridNum; k++)
+				pixels[(y_gridNum-1-j)*x_gridNum+k] = fixedBins[j*x_gridNum+k] ? 0 : 255;
+		plotfile.open((fixedName + ".pgm").c_str(), ios::binary);
+		plotfile << "P5\n" << x_gridNum << " " << y_gridNum << "\n255\n";
+		plotfile.write((const char*)pixels.data(), pixels.size());
+		plotfile.close();
+	}
+	return;
+}
 
-  clip_index = 0.02*(numBins-skipped_bin_cnt);
-  for(int j=numBins-1;j>numBins-1-clip_index;j--) {
-    abu2+=util_array[j];
-  }
-  abu2=(clip_index) ? abu2/clip_index : util_array[numBins-1];
+/* *********************************************************************** */
+/*  Desc: turn density plots on (PLOT_GNUPLOT, PLOT_PPM, PLOT_FLOAT) or    */
+/*        off (PLOT_NONE). every measure_ABU or plot_density call writes   */
+/*        a new frame, prefix_0000, prefix_0001, .. for a density movie   */
+/* *********************************************************************** */
+void circuit::set_density_plot(unsigned format, const string &prefix)
+{
+	wait_density_plot();
+	plot_format = format;
+	plot_prefix = prefix;
+	plot_frame = 0;
+	return;
+}
 
-  clip_index = 0.05*(numBins-skipped_bin_cnt);
-  for(int j=numBins-1;j>numBins-1-clip_index;j--) {
-    abu5+=util_array[j];
-  }
-  abu5=(clip_index) ? abu5/clip_index : util_array[numBins-1];
+/* ******************************************************************* */
+/*  Desc: copy a density map & write it on a background thread; the   */
+/*        previous frame is finished first                            */
+/* ******************************************************************* */
+void circuit::start_density_plot(const vector<double> &util_array, const vector<density_bin> &bins, int x_gridNum, int y_gridNum)
+{
+	vector<unsigned char> fixedBins;
+	if(plot_frame == 0)
+	{
+		fixedBins.resize(bins.size());
+		for(unsigned binId=0 ; binId<bins.size() ; binId++)
+			fixedBins[binId] = (bins[binId].f_util > 0);
+	}
+	char frame[16];
+	sprintf(frame, "_%04u", plot_frame++);
 
-  clip_index = 0.10*(numBins-skipped_bin_cnt);
-  for(int j=numBins-1;j>numBins-1-clip_index;j--) {
-    abu10+=util_array[j];
-  }
-  abu10=(clip_index) ? abu10/clip_index : util_array[numBins-1];
+	wait_density_plot();
+	plot_writer = thread(write_density_plot, plot_format, plot_prefix + frame, util_array, fixedBins, x_gridNum, y_gridNum);
+	return;
+}
 
-  clip_index = 0.20*(numBins-skipped_bin_cnt);
-  for(int j=numBins-1;j>numBins-1-clip_index;j--) {
-    abu20+=util_array[j];
-  }
-  abu20=(clip_index) ? abu20/clip_index : util_array[numBins-1];
-  util_array.clear();
+/* ******************************************************************** */
+/*  Desc: plot the density map of init_density at the current cell     */
+/*        locations, e.g. once per placement iteration                 */
+/* ******************************************************************** */
+void circuit::plot_density()
+{
+	assert(!density_bins.empty());
+	if(plot_format != PLOT_NONE)
+		start_density_plot(bin_util, density_bins, density_xnum, density_ynum);
+	return;
+}
 
-  cout << "  target util     : "<< targUt <<endl;
-  cout << "  ABU_2,5,10,20   : "<< abu2 <<", "<< abu5 <<", "<< abu10 <<", "<< abu20 <<endl;
+/* ************************************************ */
+/*  Desc: wait until the last plot is written out   */
+/* ************************************************ */
+void circuit::wait_density_plot()
+{
+	if(plot_writer.joinable())
+		plot_writer.join();
+	return;
+}
 
-  /* calculate overflow & ABU_penalty */
-  abu1=max(0.0, abu1/targUt-1.0);
-  abu2=max(0.0, abu2/targUt-1.0);
-  abu5=max(0.0, abu5/targUt-1.0);
-  abu10=max(0.0, abu10/targUt-1.0);
-  abu20=max(0.0, abu20/targUt-1.0);
-  ABU_penalty=(ABU2_WGT*abu2+ABU5_WGT*abu5+ABU10_WGT*abu10+ABU20_WGT*abu20)/(double)(ABU2_WGT+ABU5_WGT+ABU10_WGT+ABU20_WGT);
-  return;
+/* ******************************************************************* */
+/*  Desc: run job(0) .. job(numThreads-1), job(0) on the calling thread */
+/* ******************************************************************* */
+void run_threads(unsigned numThreads, const function<void(unsigned)> &job)
+{
+	vector<thread> workers;
+	for(unsigned t=1 ; t<numThreads ; t++)
+		workers.push_back(thread(job, t));
+	job(0);
+	for(unsigned t=0 ; t<workers.size() ; t++)
+		workers[t].join();
+	return;
+}
+
+/* ******************************************************************* */
+/*  Desc: bit reversal & twiddle factors for length n cosine/sine      */
+/*        transforms, which run on 2n-point complex FFTs               */
+/* ******************************************************************* */
+static void dct_init(dct_plan &plan, unsigned n)
+{
+	unsigned len = 2*n, bits = 0;
+	while((1u << bits) < len)
+		bits++;
+	plan.size = n;
+	plan.bitrev.resize(len);
+	for(unsigned i=0 ; i<len ; i++)
+	{
+		unsigned r = 0;
+		for(unsigned b=0 ; b<bits ; b++)
+			if(i & (1u << b))
+				r |= 1u << (bits-1-b);
+		plan.bitrev[i] = r;
+	}
+	plan.twiddle.resize(n);
+	plan.shift.resize(n);
+	for(unsigned k=0 ; k<n ; k++)
+	{
+		plan.twiddle[k] = polar(1.0, -2.0*M_PI*k/len);
+		plan.shift[k] = polar(1.0, -M_PI*k/len);
+	}
+	return;
+}
+
+/* ******************************************************************* */
+/*  Desc: in-place 2N-point radix-2 FFT; the inverse uses exp(+i ..)   */
+/*        & is not scaled                                              */
+/* ******************************************************************* */
+static void fft_run(const dct_plan &plan, complex<double>* a, bool inverse)
+{
+	unsigned len = 2*plan.size;
+	for(unsigned i=0 ; i<len ; i++)
+		if(i < plan.bitrev[i])
+			swap(a[i], a[ plan.bitrev[i] ]);
+	for(unsigned half=1 ; half<len ; half<<=1)
+	{
+		unsigned step = plan.size / half;
+		for(unsigned i=0 ; i<len ; i+=2*half)
+			for(unsigned k=0 ; k<half ; k++)
+			{
+				// NOTE: written out, since complex<double>::operator* checks for NaNs
+				double wr = plan.twiddle[k*step].real(), wi = inverse ? -plan.twiddle[k*step].imag() : plan.twiddle[k*step].imag();
+				complex<double> &lo = a[i+k], &hi = a[i+k+half];
+				double tr = wr*hi.real() - wi*hi.imag(), ti = wr*hi.imag() + wi*hi.real();
+				hi = complex<double>(lo.real() - tr, lo.imag() - ti);
+				lo = complex<double>(lo.real() + tr, lo.imag() + ti);
+			}
+	}
+	return;
+}
+
+/* ******************************************************************** */
+/*  Desc: in-place DCT_II, DCT_III or DST_III of line[0], line[stride], */
+/*        .. line[(N-1)*stride], through a zero-padded 2N-point FFT     */
+/* ******************************************************************** */
+static void dct_run(const dct_plan &plan, complex<double>* work, double* line, unsigned stride, unsigned type)
+{
+	unsigned n = plan.size;
+	if(type == DCT_II)
+	{
+		for(unsigned k=0 ; k<n ; k++)
+			work[k] = complex<double>(line[k*stride], 0.0);
+		fill(work+n, work+2*n, complex<double>(0.0, 0.0));
+		fft_run(plan, work, false);
+		for(unsigned u=0 ; u<n ; u++)
+			line[u*stride] = plan.shift[u].real()*work[u].real() - plan.shift[u].imag()*work[u].imag();
+		return;
+	}
+	for(unsigned u=0 ; u<n ; u++)
+		work[u] = complex<double>(plan.shift[u].real()*line[u*stride], -plan.shift[u].imag()*line[u*stride]);
+	fill(work+n, work+2*n, complex<double>(0.0, 0.0));
+	fft_run(plan, work, true);
+	for(unsigned k=0 ; k<n ; k++)
+		line[k*stride] = (type == DCT_III) ? work[k].real() : work[k].imag();
+	return;
+}
+
+/* ************************************************************************ */
+/*  Desc: set up an ePlace-style electrostatic density model: a power of 2  */
+/*        grid of at most unit x unit row height bins, with its transform   */
+/*        plans & buffers, which are reused by every measure_electro call   */
+/* ************************************************************************ */
+void circuit::init_electro(double unit)
+{
+	double gridUnit = unit * rowHeight;
+	electro_xnum = 1;
+	while(electro_xnum < ceil((rx - lx)/gridUnit))
+		electro_xnum *= 2;
+	electro_ynum = 1;
+	while(electro_ynum < ceil((ty - by)/gridUnit))
+		electro_ynum *= 2;
+	electro_binW = (rx - lx) / electro_xnum;
+	electro_binH = (ty - by) / electro_ynum;
+
+	dct_init(electro_xplan, electro_xnum);
+	dct_init(electro_yplan, electro_ynum);
+	unsigned numBins = electro_xnum*electro_ynum;
+	electro_rho.resize(numBins);
+	electro_psi.resize(numBins);
+	electro_ex.resize(numBins);
+	electro_ey.resize(numBins);
+
+	electro_threads = max(1u, thread::hardware_concurrency());
+	electro_partial.resize(electro_threads);
+	electro_work.resize(electro_threads);
+	for(unsigned t=0 ; t<electro_threads ; t++)
+		electro_work[t].resize(2*max(electro_xnum, electro_ynum));
+
+	cout << "  electro bins    : "<< electro_xnum << " x "<< electro_ynum 
+		<< " ( "<< electro_binW << " x "<< electro_binH << " )"<< endl;
+	return;
+}
+
+/* ******************************************************************* */
+/*  Desc: bins overlapped by cell i, with the overlap as a fraction of */
+/*        the bin area                                                 */
+/* ******************************************************************* */
+void circuit::electro_overlaps(unsigned i, vector< pair<unsigned, double> > &overlaps)
+{
+	overlaps.clear();
+	double x1 = cell_x[i], x2 = x1 + cells[i].width;
+	double y1 = cell_y[i], y2 = y1 + cells[i].height;
+	int lcol = max((int)floor((x1-lx)/electro_binW), 0);
+	int rcol = min((int)floor((x2-lx)/electro_binW), electro_xnum-1);
+	int brow = max((int)floor((y1-by)/electro_binH), 0);
+	int trow = min((int)floor((y2-by)/electro_binH), electro_ynum-1);
+	for(int j=brow ; j<=trow ; j++)
+	{
+		double h = min(by + (j+1)*electro_binH, y2) - max(by + j*electro_binH, y1);
+		if(h <= 0.0)
+			continue;
+		for(int k=lcol ; k<=rcol ; k++)
+		{
+			double w = min(lx + (k+1)*electro_binW, x2) - max(lx + k*electro_binW, x1);
+			if(w > 0.0)
+				overlaps.push_back(make_pair(j*electro_xnum+k, w*h / (electro_binW*electro_binH)));
+		}
+	}
+	return;
+}
+
+/* ******************************************************************** */
+/*  Desc: 2-D transform of a grid, xtype along the rows & ytype along  */
+/*        the columns, each split among the threads                     */
+/* ******************************************************************** */
+void circuit::electro_transform(vector<double> &grid, unsigned xtype, unsigned ytype)
+{
+	int M = electro_xnum, N = electro_ynum;
+	run_threads(electro_threads, [&](unsigned t) {
+		for(int j = N*t/electro_threads ; j < (int)(N*(t+1)/electro_threads) ; j++)
+			dct_run(electro_xplan, electro_work[t].data(), &grid[j*M], 1, xtype);
+	});
+	run_threads(electro_threads, [&](unsigned t) {
+		for(int k = M*t/electro_threads ; k < (int)(M*(t+1)/electro_threads) ; k++)
+			dct_run(electro_yplan, electro_work[t].data(), &grid[k], M, ytype);
+	});
+	return;
+}
+
+/* ************************************************************************* */
+/*  Desc: electrostatic density penalty. the cells (fixed ones included)    */
+/*        are charges; the potential psi solves the Poisson equation         */
+/*        lap(psi) = -rho on the bin grid with Neumann boundaries, by cosine */
+/*        series, & the field is -grad(psi). returns the energy             */
+/*        1/2 sum rho*psi (in bin units) & fills grad_x/grad_y with the     */
+/*        gradient per DBU of each movable cell, -q*field                   */
+/* ************************************************************************* */
+double circuit::measure_electro(vector<double> &grad_x, vector<double> &grad_y)
+{
+	assert(electro_xnum > 0);
+	int M = electro_xnum, N = electro_ynum;
+	unsigned numBins = M*N, numCells = cells.size();
+	grad_x.assign(numCells, 0.0);
+	grad_y.assign(numCells, 0.0);
+
+	/* 1. charge density; each thread adds a share of the cells to its own grid */
+	run_threads(electro_threads, [&](unsigned t) {
+		vector< pair<unsigned, double> > overlaps;
+		electro_partial[t].assign(numBins, 0.0);
+		for(unsigned i = numCells*t/electro_threads ; i < numCells*(t+1)/electro_threads ; i++)
+		{
+			electro_overlaps(i, overlaps);
+			for(unsigned o=0 ; o<overlaps.size() ; o++)
+				electro_partial[t][ overlaps[o].first ] += overlaps[o].second;
+		}
+	});
+	for(unsigned b=0 ; b<numBins ; b++)
+	{
+		electro_rho[b] = electro_partial[0][b];
+		for(unsigned t=1 ; t<electro_threads ; t++)
+			electro_rho[b] += electro_partial[t][b];
+	}
+
+	/* 2. cosine coefficients of rho, & those of psi & the field */
+	electro_psi = electro_rho;
+	electro_transform(electro_psi, DCT_II, DCT_II);
+	for(int v=0 ; v<N ; v++)
+		for(int u=0 ; u<M ; u++)
+		{
+			unsigned b = v*M+u;
+			// NOTE: the constant term is dropped, i.e. the charge is balanced by a uniform background
+			if(u == 0 && v == 0)
+			{
+				electro_psi[b] = electro_ex[b] = electro_ey[b] = 0.0;
+				continue;
+			}
+			double a = electro_psi[b] * (u ? 2.0 : 1.0) / M * (v ? 2.0 : 1.0) / N;
+			double wu = M_PI*u/M, wv = M_PI*v/N, w2 = wu*wu + wv*wv;
+			electro_psi[b] = a / w2;
+			electro_ex[b] = a * wu / w2;
+			electro_ey[b] = a * wv / w2;
+		}
+
+	/* 3. potential & field at the bin centers */
+	electro_transform(electro_psi, DCT_III, DCT_III);
+	electro_transform(electro_ex, DST_III, DCT_III);
+	electro_transform(electro_ey, DCT_III, DST_III);
+	double energy = 0.0;
+	for(unsigned b=0 ; b<numBins ; b++)
+		energy += electro_rho[b] * electro_psi[b];
+	energy *= 0.5;
+
+	/* 4. gradient of each movable cell */
+	run_threads(electro_threads, [&](unsigned t) {
+		vector< pair<unsigned, double> > overlaps;
+		for(unsigned i = numCells*t/electro_threads ; i < numCells*(t+1)/electro_threads ; i++)
+		{
+			if(cells[i].isFixed)
+				continue;
+			electro_overlaps(i, overlaps);
+			for(unsigned o=0 ; o<overlaps.size() ; o++)
+			{
+				grad_x[i] -= overlaps[o].second * electro_ex[ overlaps[o].first ];
+				grad_y[i] -= overlaps[o].second * electro_ey[ overlaps[o].first ];
+			}
+			grad_x[i] /= electro_binW;
+			grad_y[i] /= electro_binH;
+		}
+	});
+	return energy;
+}
+
+#ifdef EVALUATE_AVX2
+/* ************************************************************************ */
+/*  Desc: AVX2 bodies of measure_HPWL() for the 2-pin & 3-pin net buckets   */
+/*        four nets at a time; pins are stored column-major (see            */
+/*        build_connectivity). return the HPWL sum (in DBU) & set done to   */
+/*        the number of nets handled                                        */
+/* ************************************************************************ */
+__attribute__((target("avx2")))
+static inline __m256d gather_pd(const double* base, __m128i index)
+{
+	// NOTE: the masked form, since the plain one reads an undefined source register
+	const __m256d all = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+	return _mm256_mask_i32gather_pd(_mm256_setzero_pd(), base, index, all, 8);
+}
+
+__attribute__((target("avx2")))
+static double hpwl_reduce(__m256d sum)
+{
+	double lanes[4];
+	_mm256_storeu_pd(lanes, sum);
+	return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
 }
 
+__attribute__((target("avx2")))
+static double hpwl_deg2_avx2(unsigned num, const unsigned* pins, const double* x, const double* y, unsigned &done)
+{
+	const __m256d signMask = _mm256_set1_pd(-0.0);
+	__m256d sum = _mm256_setzero_pd();
+	unsigned i=0;
+	for( ; i+4 <= num ; i+=4)
+	{
+		__m128i a = _mm_loadu_si128((const __m128i*)(pins+i));
+		__m128i b = _mm_loadu_si128((const __m128i*)(pins+num+i));
+		__m256d dx = _mm256_sub_pd(gather_pd(x, a), gather_pd(x, b));
+		__m256d dy = _mm256_sub_pd(gather_pd(y, a), gather_pd(y, b));
+		sum = _mm256_add_pd(sum, _mm256_add_pd(_mm256_andnot_pd(signMask, dx), _mm256_andnot_pd(signMask, dy)));
+	}
+	done = i;
+	return hpwl_reduce(sum);
+}
+
+__attribute__((target("avx2")))
+static double hpwl_deg3_avx2(unsigned num, const unsigned* pins, const double* x, const double* y, unsigned &done)
+{
+	__m256d sum = _mm256_setzero_pd();
+	unsigned i=0;
+	for( ; i+4 <= num ; i+=4)
+	{
+		__m128i a = _mm_loadu_si128((const __m128i*)(pins+i));
+		__m128i b = _mm_loadu_si128((const __m128i*)(pins+num+i));
+		__m128i c = _mm_loadu_si128((const __m128i*)(pins+2*num+i));
+		__m256d xa = gather_pd(x, a), xb = gather_pd(x, b), xc = gather_pd(x, c);
+		__m256d ya = gather_pd(y, a), yb = gather_pd(y, b), yc = gather_pd(y, c);
+		__m256d w = _mm256_sub_pd(_mm256_max_pd(_mm256_max_pd(xa, xb), xc), _mm256_min_pd(_mm256_min_pd(xa, xb), xc));
+		__m256d h = _mm256_sub_pd(_mm256_max_pd(_mm256_max_pd(ya, yb), yc), _mm256_min_pd(_mm256_min_pd(ya, yb), yc));
+		sum = _mm256_add_pd(sum, _mm256_add_pd(w, h));
+	}
+	done = i;
+	return hpwl_reduce(sum);
+}
+#endif
+
 /* ***************************************** */
 /*  Desc: measure Half-perimeter Wirelength  */
 /* ***************************************** */
 void circuit::measure_HPWL()
 {
   update_pinlocs();
-  double totalX=0.0;
-  double totalY=0.0;
+	unsigned num2 = deg2_pins.size()/2, num3 = deg3_pins.size()/3;
+	double total=0.0;
 
-  for(vector<net>::iterator theNet=nets.begin() ; theNet != nets.end() ; ++theNet)
+	// 2-pin & 3-pin nets, four at a time if possible
+	unsigned i=0, j=0;
+#ifdef EVALUATE_AVX2
+	if(__builtin_cpu_supports("avx2"))
+	{
+		total += hpwl_deg2_avx2(num2, deg2_pins.data(), pin_x.data(), pin_y.data(), i);
+		total += hpwl_deg3_avx2(num3, deg3_pins.data(), pin_x.data(), pin_y.data(), j);
+	}
+#endif
+	for( ; i<num2 ; i++)
+	{
+		unsigned a = deg2_pins[i], b = deg2_pins[num2+i];
+		total += fabs(pin_x[a] - pin_x[b]) + fabs(pin_y[a] - pin_y[b]);
+	}
+	for( ; j<num3 ; j++)
+	{
+		unsigned a = deg3_pins[j], b = deg3_pins[num3+j], c = deg3_pins[2*num3+j];
+		total += max(max(pin_x[a], pin_x[b]), pin_x[c]) - min(min(pin_x[a], pin_x[b]), pin_x[c]);
+		total += max(max(pin_y[a], pin_y[b]), pin_y[c]) - min(min(pin_y[a], pin_y[b]), pin_y[c]);
+	}
+
+	// all the other nets
+  for(vector<unsigned>::iterator theNet=degN_nets.begin() ; theNet != degN_nets.end() ; ++theNet)
   {
+		unsigned begin = net_pin_start[*theNet], end = net_pin_start[*theNet+1];
     double netMaxX, netMinX;
     double netMaxY, netMinY;
-    netMaxX=netMinX=pins[ theNet->source ].x_coord;
-    netMaxY=netMinY=pins[ theNet->source ].y_coord;
-    for(vector<unsigned>::iterator thePin=theNet->sinks.begin() ; thePin != theNet->sinks.end() ; ++thePin)
+    netMaxX=netMinX=pin_x[ net_pins[begin] ];
+    netMaxY=netMinY=pin_y[ net_pins[begin] ];
+    for(unsigned p=begin+1 ; p<end ; p++)
     {
-      netMaxX=max(netMaxX, pins[ *thePin ].x_coord);
-      netMinX=min(netMinX, pins[ *thePin ].x_coord);
-      netMaxY=max(netMaxY, pins[ *thePin ].y_coord);
-      netMinY=min(netMinY, pins[ *thePin ].y_coord);
+      netMaxX=max(netMaxX, pin_x[ net_pins[p] ]);
+      netMinX=min(netMinX, pin_x[ net_pins[p] ]);
+      netMaxY=max(netMaxY, pin_y[ net_pins[p] ]);
+      netMinY=min(netMinY, pin_y[ net_pins[p] ]);
     }
-    totalX+=netMaxX-netMinX;
-    totalY+=netMaxY-netMinY;
+    total+=(netMaxX-netMinX)+(netMaxY-netMinY);
   }
 
-  total_HPWL=(totalX+totalY) / static_cast<double>(DEFdist2Microns);
+  total_HPWL=total / static_cast<double>(DEFdist2Microns);
   return;
 }
+
+/* ********************************************************************* */
+/*  Desc: recompute the bounding box of a net & its boundary pin counts  */
+/* ********************************************************************* */
+void circuit::rescan_net_box(unsigned theNet)
+{
+	net_box &box = net_boxes[theNet];
+	unsigned begin = net_pin_start[theNet], end = net_pin_start[theNet+1];
+	if(begin == end)
+	{
+		box.lx = box.hx = box.ly = box.hy = 0.0;
+		box.nlx = box.nhx = box.nly = box.nhy = 0;
+		return;
+	}
+	box.lx = box.hx = pin_x[ net_pins[begin] ];
+	box.ly = box.hy = pin_y[ net_pins[begin] ];
+	box.nlx = box.nhx = box.nly = box.nhy = 1;
+	for(unsigned i=begin+1 ; i<end ; i++)
+	{
+		double x = pin_x[ net_pins[i] ], y = pin_y[ net_pins[i] ];
+		if(x < box.lx)       { box.lx = x; box.nlx = 1; }
+		else if(x == box.lx)   box.nlx++;
+		if(x > box.hx)       { box.hx = x; box.nhx = 1; }
+		else if(x == box.hx)   box.nhx++;
+		if(y < box.ly)       { box.ly = y; box.nly = 1; }
+		else if(y == box.ly)   box.nly++;
+		if(y > box.hy)       { box.hy = y; box.nhy = 1; }
+		else if(y == box.hy)   box.nhy++;
+	}
+	return;
+}
+
+/* ************************************************************************ */
+/*  Desc: move one pin of a net from (oldX, oldY) to (newX, newY) in its box  */
+/*        returns false if a boundary lost its last pin, i.e., the box has  */
+/*        to be rescanned                                                   */
+/* ************************************************************************ */
+bool circuit::move_pin_in_box(net_box &box, double oldX, double oldY, double newX, double newY)
+{
+	// the new location first, so that a boundary pin moving outward stays counted
+	if(newX < box.lx)       { box.lx = newX; box.nlx = 1; }
+	else if(newX == box.lx)   box.nlx++;
+	if(newX > box.hx)       { box.hx = newX; box.nhx = 1; }
+	else if(newX == box.hx)   box.nhx++;
+	if(newY < box.ly)       { box.ly = newY; box.nly = 1; }
+	else if(newY == box.ly)   box.nly++;
+	if(newY > box.hy)       { box.hy = newY; box.nhy = 1; }
+	else if(newY == box.hy)   box.nhy++;
+
+	if(oldX == box.lx && --box.nlx == 0) return false;
+	if(oldX == box.hx && --box.nhx == 0) return false;
+	if(oldY == box.ly && --box.nly == 0) return false;
+	if(oldY == box.hy && --box.nhy == 0) return false;
+	return true;
+}
+
+/* ******************************************************************** */
+/*  Desc: build the per-net bounding boxes used by move_cells() from    */
+/*        the current placement; also sets total_HPWL                   */
+/* ******************************************************************** */
+void circuit::init_HPWL()
+{
+  update_pinlocs();
+	net_boxes.resize(nets.size());
+	net_stamp.assign(nets.size(), 0);
+	move_stamp = 0;
+	HPWL_dbu = 0.0;
+	for(unsigned n=0 ; n<nets.size() ; n++)
+	{
+		rescan_net_box(n);
+		HPWL_dbu += (net_boxes[n].hx - net_boxes[n].lx) + (net_boxes[n].hy - net_boxes[n].ly);
+	}
+  total_HPWL = HPWL_dbu / static_cast<double>(DEFdist2Microns);
+	return;
+}
+
+/* ************************************************************************* */
+/*  Desc: move a batch of cells & update the HPWL of their nets only         */
+/*        a net box is rescanned only if one of its boundaries lost its last */
+/*        pin. returns the HPWL delta (in microns) & updates total_HPWL     */
+/*        so are the density map, window tables, legality counts & site    */
+/*        map, if they were initialized                                      */
+/* ************************************************************************* */
+double circuit::move_cells(const vector<cell_move> &moves)
+{
+	assert(net_boxes.size() == nets.size() || !density_bins.empty() || !sat_movable.empty() || !legal_counts.empty() 
+	       || !site_words.empty());
+	// NOTE: stamps tell which nets were already touched, without clearing a flag per call
+	if(++move_stamp == 0)
+	{
+		net_stamp.assign(nets.size(), 0);
+		move_stamp = 1;
+	}
+	touched_nets.clear();
+	touched_HPWL.clear();
+
+	for(vector<cell_move>::const_iterator theMove = moves.begin() ; theMove != moves.end() ; ++theMove)
+	{
+		unsigned c = theMove->cell;
+		double dx = theMove->x_coord - cell_x[c], dy = theMove->y_coord - cell_y[c];
+		cell_x[c] = theMove->x_coord;
+		cell_y[c] = theMove->y_coord;
+		if(dx == 0.0 && dy == 0.0)
+			continue;
+		if(!density_bins.empty())
+			move_cell_density(c, cell_x[c] - dx, cell_y[c] - dy);
+		if(!sat_movable.empty())
+		{
+			add_cell_sat(c, cell_x[c] - dx, cell_y[c] - dy, -1);
+			add_cell_sat(c, cell_x[c], cell_y[c], 1);
+		}
+		if(!legal_counts.empty())
+		{
+			add_cell_legality(c, cell_x[c] - dx, cell_y[c] - dy, -1);
+			add_cell_legality(c, cell_x[c], cell_y[c], 1);
+		}
+		if(!site_words.empty())
+		{
+			mark_sites(c, cell_x[c] - dx, cell_y[c] - dy, false);
+			mark_sites(c, cell_x[c], cell_y[c], true);
+		}
+		if(net_boxes.size() != nets.size())
+			continue;
+
+		for(unsigned p=cell_pin_start[c] ; p<cell_pin_start[c+1] ; p++)
+		{
+			unsigned thePin = cell_pins[p];
+			unsigned theNet = pins[ thePin ].net;
+			net_box &box = net_boxes[theNet];
+			if(net_stamp[theNet] != move_stamp)
+			{
+				net_stamp[theNet] = move_stamp;
+				touched_nets.push_back(theNet);
+				touched_HPWL.push_back((box.hx - box.lx) + (box.hy - box.ly));
+			}
+
+			double oldX = pin_x[ thePin ], oldY = pin_y[ thePin ];
+			pin_x[ thePin ] = cell_x[c] + pin_xoff[ thePin ];
+			pin_y[ thePin ] = cell_y[c] + pin_yoff[ thePin ];
+			// NOTE: a box to be rescanned is marked by an empty boundary count
+			if(box.nlx != 0 && !move_pin_in_box(box, oldX, oldY, pin_x[ thePin ], pin_y[ thePin ]))
+				box.nlx = 0;
+		}
+	}
+
+	double delta = 0.0;
+	for(unsigned i=0 ; i<touched_nets.size() ; i++)
+	{
+		net_box &box = net_boxes[ touched_nets[i] ];
+		if(box.nlx == 0 || box.nhx == 0 || box.nly == 0 || box.nhy == 0)
+			rescan_net_box(touched_nets[i]);
+		delta += (box.hx - box.lx) + (box.hy - box.ly) - touched_HPWL[i];
+	}
+	HPWL_dbu += delta;
+  total_HPWL = HPWL_dbu / static_cast<double>(DEFdist2Microns);
+	return delta / static_cast<double>(DEFdist2Microns);
+}
+
+/* ************************************************************************ */
+/*  Desc: smooth wirelength & its gradient for nets [firstNet, lastNet)    */
+/*        the gradient of each pin is added to its owner cell; PIs & POs   */
+/*        do not move. exponents are shifted by the net's max/min so that  */
+/*        they never overflow                                               */
+/* ************************************************************************ */
+double circuit::smooth_WL_nets(unsigned model, double gamma, unsigned firstNet, unsigned lastNet, double* grad_x, double* grad_y)
+{
+	vector<double> coord, ePos, eNeg;   /* pin coordinates of one net & their exponentials */
+	double cost=0.0;
+	for(unsigned n=firstNet ; n<lastNet ; n++)
+	{
+		unsigned begin = net_pin_start[n], degree = net_pin_start[n+1] - begin;
+		if(degree < 2)
+			continue;
+		coord.resize(degree);
+		ePos.resize(degree);
+		eNeg.resize(degree);
+		for(unsigned dim=0 ; dim<2 ; dim++)
+		{
+			const vector<double> &pinCoord = (dim == 0) ? pin_x : pin_y;
+			double* grad = (dim == 0) ? grad_x : grad_y;
+
+			double cMax = pinCoord[ net_pins[begin] ], cMin = cMax;
+			for(unsigned i=0 ; i<degree ; i++)
+			{
+				coord[i] = pinCoord[ net_pins[begin+i] ];
+				cMax = max(cMax, coord[i]);
+				cMin = min(cMin, coord[i]);
+			}
+			double sumPos=0.0, sumNeg=0.0, wsumPos=0.0, wsumNeg=0.0;
+			for(unsigned i=0 ; i<degree ; i++)
+			{
+				ePos[i] = exp((coord[i] - cMax) / gamma);
+				eNeg[i] = exp((cMin - coord[i]) / gamma);
+				sumPos += ePos[i];
+				sumNeg += eNeg[i];
+				wsumPos += coord[i] * ePos[i];
+				wsumNeg += coord[i] * eNeg[i];
+			}
+
+			if(model == LSE_MODEL)
+			{
+				cost += gamma * (log(sumPos) + log(sumNeg)) + cMax - cMin;
+				for(unsigned i=0 ; i<degree ; i++)
+				{
+					unsigned owner = pin_owner[ net_pins[begin+i] ];
+					if(owner != numeric_limits<unsigned>::max())
+						grad[owner] += ePos[i] / sumPos - eNeg[i] / sumNeg;
+				}
+			}
+			else
+			{
+				double avgPos = wsumPos / sumPos, avgNeg = wsumNeg / sumNeg;
+				cost += avgPos - avgNeg;
+				for(unsigned i=0 ; i<degree ; i++)
+				{
+					unsigned owner = pin_owner[ net_pins[begin+i] ];
+					if(owner != numeric_limits<unsigned>::max())
+						grad[owner] += ePos[i] / sumPos * (1.0 + (coord[i] - avgPos) / gamma)
+						             - eNeg[i] / sumNeg * (1.0 - (coord[i] - avgNeg) / gamma);
+				}
+			}
+		}
+	}
+	return cost;
+}
+
+/* ************************************************************************* */
+/*  Desc: weighted-average (WA_MODEL) or log-sum-exp (LSE_MODEL) wirelength  */
+/*        with smoothing parameter gamma, for analytic placement             */
+/*        returns the total (in DBU) & fills grad_x/grad_y per cell. nets   */
+/*        are split among threads by pin count, each thread with its own    */
+/*        gradient buffers that are summed up at the end                    */
+/* ************************************************************************* */
+double circuit::measure_smooth_WL(unsigned model, double gamma, vector<double> &grad_x, vector<double> &grad_y)
+{
+	assert(model == WA_MODEL || model == LSE_MODEL);
+	assert(gamma > 0.0);
+  update_pinlocs();
+	unsigned numCells = cells.size(), numNets = nets.size();
+	grad_x.assign(numCells, 0.0);
+	grad_y.assign(numCells, 0.0);
+
+	unsigned numThreads = max(1u, thread::hardware_concurrency());
+	numThreads = min(numThreads, (unsigned)(net_pins.size() / (1 << 14)) + 1);
+	vector<unsigned> bounds(numThreads+1, numNets);
+	bounds[0] = 0;
+	for(unsigned t=1 ; t<numThreads ; t++)
+		bounds[t] = lower_bound(net_pin_start.begin(), net_pin_start.end()-1, 
+				(unsigned)((unsigned long long)net_pins.size() * t / numThreads)) - net_pin_start.begin();
+
+	vector<double> cost(numThreads, 0.0);
+	vector< vector<double> > localGrad(2*(numThreads-1));
+	run_threads(numThreads, [&](unsigned t) {
+		if(t == 0)
+		{
+			cost[0] = smooth_WL_nets(model, gamma, bounds[0], bounds[1], grad_x.data(), grad_y.data());
+			return;
+		}
+		localGrad[2*t-2].assign(numCells, 0.0);
+		localGrad[2*t-1].assign(numCells, 0.0);
+		cost[t] = smooth_WL_nets(model, gamma, bounds[t], bounds[t+1], localGrad[2*t-2].data(), localGrad[2*t-1].data());
+	});
+
+	double total = cost[0];
+	for(unsigned t=1 ; t<numThreads ; t++)
+	{
+		total += cost[t];
+		for(unsigned c=0 ; c<numCells ; c++)
+		{
+			grad_x[c] += localGrad[2*t-2][c];
+			grad_y[c] += localGrad[2*t-1][c];
+		}
+	}
+	return total;
+}
@@ -13,14 +13,20 @@
 #include <iostream>
 #include <fstream>
 #include <cstdlib>
+#include <cstdio>
 #include <cstring>
 #include <sstream>
 #include <vector>
 #include <map>
+#include <set>
 #include <cmath>
 #include <climits>
 #include <algorithm>
 #include <limits>
+#include <thread>
+#include <complex>
+#include <functional>
+#include <atomic>
 #include <assert.h>
 
 /* density profiling related parms */
@@ -34,6 +40,17 @@
 #define ABU10_WGT 2
 #define ABU20_WGT 1
 
+/* density plot formats (see set_density_plot) */
+#define PLOT_NONE    0         /* no plot (default) */
+#define PLOT_GNUPLOT 1         /* gnuplot text matrix */
+#define PLOT_PPM     2         /* binary color heatmap */
+#define PLOT_FLOAT   3         /* raw float32 matrix, bottom row first */
+
+/* 1-D transforms of the electrostatic density (see dct_run) */
+#define DCT_II  0              /* X_u = sum_k x_k cos(pi u (2k+1) / 2N) */
+#define DCT_III 1              /* x_k = sum_u X_u cos(pi u (2k+1) / 2N) */
+#define DST_III 2              /* x_k = sum_u X_u sin(pi u (2k+1) / 2N) */
+
 #define INIT false
 #define FINAL true
 
@@ -41,6 +58,18 @@
 #define PO_PIN 2
 #define NONPIO_PIN 3
 
+#define WA_MODEL  1            /* weighted-average wirelength */
+#define LSE_MODEL 2            /* log-sum-exp wirelength */
+
+/* legalization (see legalize) */
+#define LEGAL_BAND_LINES 16    /* row lines per band; bands are legalized in parallel */
+#define LEGAL_SHIFT_SITES 64   /* sites on each side of a cell's range that may be shifted */
+
+#define PIN_NODE     1
+#define DRVOUT_NODE  2
+#define STEINER_NODE 3
+#define SLICE_NODE   4
+
 /* current timer doesn't scale well */
 #define MAX_WIRE_TAPS 200000
 #define MAX_INTERNAL_NODES 50000
@@ -50,6 +79,125 @@
 
 using namespace std;
 
+/* bump allocator for the names & per-object lists of the circuit, which */
+/* live as long as it does. memory is handed out from 1MB blocks & only   */
+/* released with the arena                                                */
+class arena
+{
+  public:
+    arena() : cur(NULL), left(0), used(0) {}
+    ~arena();
+    void* allocate(size_t bytes);
+    size_t size() const { return used; }  /* bytes handed out so far */
+
+  private:
+    arena(const arena&);
+    arena& operator=(const arena&);
+    vector<char*> blocks;
+    char* cur;
+    size_t left;
+    size_t used;
+};
+
+/* containers with this allocator take their memory from an arena, or from */
+/* the heap if they were not given one; the arena goes along on assignment */
+template <class T>
+struct arena_allocator
+{
+  typedef T value_type;
+  typedef true_type propagate_on_container_copy_assignment;
+  typedef true_type propagate_on_container_move_assignment;
+  typedef true_type propagate_on_container_swap;
+  arena* pool;
+
+  arena_allocator() : pool(NULL) {}
+  arena_allocator(arena* pool) : pool(pool) {}
+  template <class U> arena_allocator(const arena_allocator<U> &other) : pool(other.pool) {}
+  T* allocate(size_t n) 
+  { 
+    return static_cast<T*>(pool ? pool->allocate(n * sizeof(T)) : ::operator new(n * sizeof(T))); 
+  }
+  void deallocate(T* p, size_t) { if(!pool) ::operator delete(p); }
+  template <class U> bool operator==(const arena_allocator<U> &other) const { return pool == other.pool; }
+  template <class U> bool operator!=(const arena_allocator<U> &other) const { return pool != other.pool; }
+};
+
+typedef vector<unsigned, arena_allocator<unsigned> > id_list;
+
+/* a name stored once in the circuit's arena (see intern_name) */
+struct name_ref
+{
+  const char* str;             /* '\0' terminated */
+  unsigned len;
+
+  name_ref() : str(""), len(0) {}
+  name_ref(const char* str, unsigned len) : str(str), len(len) {}
+  const char* c_str() const { return str; }
+  size_t length() const { return len; }
+  size_t size() const { return len; }
+  bool empty() const { return len == 0; }
+  operator string() const { return string(str, len); }
+};
+
+inline bool operator==(const name_ref &a, const char* b) { return strncmp(a.str, b, a.len) == 0 && b[a.len] == '\0'; }
+inline bool operator==(const name_ref &a, const string &b) { return a.len == b.size() && memcmp(a.str, b.data(), a.len) == 0; }
+inline bool operator!=(const name_ref &a, const char* b) { return !(a == b); }
+inline bool operator!=(const name_ref &a, const string &b) { return !(a == b); }
+inline string operator+(const name_ref &a, const char* b) { return string(a) + b; }
+inline string operator+(const name_ref &a, const string &b) { return string(a) + b; }
+inline ostream& operator<<(ostream &os, const name_ref &a) { return os.write(a.str, a.len); }
+
+name_ref intern_name(arena &pool, const string &name);
+
+struct name_less
+{
+  bool operator()(const name_ref &a, const name_ref &b) const
+  {
+    int order = memcmp(a.str, b.str, min(a.len, b.len));
+    return order < 0 || (order == 0 && a.len < b.len);
+  }
+};
+
+/* name -> ID tables: the keys & tree nodes are in the circuit's arena */
+class name_map
+{
+  public:
+    typedef map<name_ref, unsigned, name_less, arena_allocator< pair<const name_ref, unsigned> > > table;
+    typedef table::iterator iterator;
+    typedef table::const_iterator const_iterator;
+
+    name_map(arena* pool) : pool(pool), names(name_less(), arena_allocator< pair<const name_ref, unsigned> >(pool)) {}
+    iterator find(const string &name) { return names.find(name_ref(name.data(), name.size())); }
+    const_iterator find(const string &name) const { return names.find(name_ref(name.data(), name.size())); }
+    iterator find(const name_ref &name) { return names.find(name); }
+    const_iterator find(const name_ref &name) const { return names.find(name); }
+    iterator begin() { return names.begin(); }
+    iterator end() { return names.end(); }
+    const_iterator end() const { return names.end(); }
+    size_t size() const { return names.size(); }
+    /* the key must be in the arena already */
+    template <class T>
+    pair<iterator, bool> insert(const pair<name_ref, T> &entry) { return names.insert(entry); }
+    template <class T>
+    pair<iterator, bool> insert(const pair<string, T> &entry)
+    {
+      iterator it = find(entry.first);
+      if(it != end())
+        return make_pair(it, false);
+      return names.insert(make_pair(intern_name(*pool, entry.first), entry.second));
+    }
+    unsigned& operator[](const string &name) { return insert(make_pair(name, 0u)).first->second; }
+    unsigned& operator[](const name_ref &name)
+    {
+      iterator it = find(name);
+      return (it != end()) ? it->second : (*this)[ string(name) ];
+    }
+
+  private:
+    arena* pool;
+    table names;
+};
+
 struct site
 {
   string name;
@@ -82,12 +230,13 @@ struct layer
 
 struct macro_pin
 {
+  string name;
   string direction;                      
   unsigned layer;
   double xLL, yLL;         /* in microns */
   double xUR, yUR;         /* in microns */
 
-	macro_pin() : direction(""), layer(0),
+	macro_pin() : name(""), direction(""), layer(0),
 				      	xLL(0.0), yLL(0.0), xUR(0.0), yUR(0.0) {}
 };
 
@@ -101,7 +250,8 @@ struct macro
   double width;                              /* in microns */
   double height;                             /* in microns */
   vector<unsigned> sites;
-	map<string, macro_pin> pins;
+	vector<macro_pin> pins;                    /* pins, densely numbered in LEF order */
+	map<string, unsigned> pin2id;              /* map between pin name and index to pins */
 
   macro() : name(""), type(""), isFlop(false), xOrig(0.0), yOrig(0.0), width(0.0), height(0.0) {}
   void print();
@@ -110,9 +260,8 @@ struct macro
 struct pin
 {
 	// from verilog
-  string name;                         /* Name of pins : instance name + "_" + port_name */
+  name_ref name;                       /* Name of pins : instance name + "_" + port_name */
   unsigned id;
-  unsigned owner;                      /* The owners of PIs or POs are UINT_MAX */
   unsigned net;
 	unsigned type;                       /* 1=PI_PIN, 2=PO_PIN, 3=others */
 	bool isFlopInput;                    /* is this pin an input of a clocked element? */
@@ -124,59 +273,81 @@ struct pin
 	int driverType;                      /* input driver for PIs */
 
 	// from .def
-  double x_coord, y_coord;             /* (in DBU) */
-  double x_offset, y_offset;           /* COG of VIA relative to the origin of a cell, (in DBU) */
+	// NOTE: the owner, offset & location are kept in circuit::pin_* arrays
   bool isFixed;                        /* is this node fixed? */
+  unsigned layer;                      /* PI/PO pin layer, if any */
+  double xLL, yLL, xUR, yUR;           /* PI/PO pin shape relative to its placed location, (in DBU) */
 
 	// from timer
 	double earlySlk, lateSlk;
 
-  pin() : name(""),
+  pin() : 
           id(numeric_limits<unsigned>::max()), 
-					owner(numeric_limits<unsigned>::max()),
           net(numeric_limits<unsigned>::max()), 
           type(numeric_limits<unsigned>::max()), 
 					isFlopInput(false),
 					cap(0.0), delay(0.0), rTran(0.0), fTran(0.0), driverType(numeric_limits<unsigned>::max()),
-					x_coord(0.0), y_coord(0.0), x_offset(0.0), y_offset(0.0), 
-					isFixed(false), earlySlk(0.0), lateSlk(0.0) {}
+					isFixed(false), layer(numeric_limits<unsigned>::max()), 
+					xLL(0.0), yLL(0.0), xUR(0.0), yUR(0.0), earlySlk(0.0), lateSlk(0.0) {}
   void print();
 };
 
 struct cell
 {
-  string name;
+  name_ref name;
 	unsigned type;                              /* index to some predefined macro */
-  int x_coord, y_coord;                       /* (in DBU) */  
   int init_x_coord, init_y_coord;             /* (in DBU) */
 	double width, height;                       /* (in DBU) */
   bool isFixed;                               /* fixed cell or not */
-  map<string, unsigned> ports;                /* <port name, index to the pin> */
+  id_list ports;                              /* index to the pin, per macro pin (max() if unconnected) */
   string cellorient;
-  int row_num;
+  int row_num;                                 /* see create_rows, -1 if on no row */
 
-  cell () : name(""), type(numeric_limits<unsigned>::max()), 
-	          x_coord(0), y_coord(0), init_x_coord(0), init_y_coord(0), 
+  cell () : type(numeric_limits<unsigned>::max()), 
+	          init_x_coord(0), init_y_coord(0), 
 						width(0.0), height(0.0),
     isFixed(false), cellorient(""),row_num(0) {}
   void print();
 };
 
+struct wire_node
+{
+  unsigned type;               /* 1=PIN_NODE, 2=DRVOUT_NODE (input driver of a PI), 3=STEINER_NODE, 4=SLICE_NODE */
+  unsigned id;                 /* pin index, Steiner point number or slice number */
+  unsigned end1, end2;         /* SLICE_NODE only: nodes at the ends of the sliced segment */
+
+  wire_node(unsigned type, unsigned id, 
+            unsigned end1=numeric_limits<unsigned>::max(), unsigned end2=numeric_limits<unsigned>::max()) 
+	  : type(type), id(id), end1(end1), end2(end2) {}
+};
+
+struct wire_seg
+{
+  unsigned from, to;           /* indices to net::wire_nodes */
+  double length;               /* (in DBU) */
+
+  wire_seg(unsigned from, unsigned to, double length) : from(from), to(to), length(length) {}
+};
+
+typedef vector<wire_node, arena_allocator<wire_node> > wire_node_list;
+typedef vector<wire_seg, arena_allocator<wire_seg> > wire_seg_list;
+
 struct net
 {
-  string name;
+  name_ref name;
   unsigned source;             /* input pin index to the net */
-  vector<unsigned> sinks;      /* sink pins indices of the net */
-  vector< pair< pair <string, string>, double > > wire_segs;   /* connecting pin (source, sink) names & length */
+  id_list sinks;               /* sink pins indices of the net */
+  wire_node_list wire_nodes;   /* nodes of the Steiner tree; the source & sinks come first, in order */
+  wire_seg_list wire_segs;     /* wire segments between wire_nodes & their lengths */
 
-  net() : name(""), source(numeric_limits<unsigned>::max()) {}
+  net() : source(numeric_limits<unsigned>::max()) {}
   void print();
 };
 
 struct row
 {
   /* from DEF file */
-  string name;
+  name_ref name;
   unsigned site;
   int origX;               /* (in DBU) */
   int origY;               /* (in DBU) */
@@ -186,11 +357,47 @@ struct row
   string siteorient;
   vector<int> cells;
 
-  row() : name(""), site(numeric_limits<unsigned>::max()), 
+  row() : site(numeric_limits<unsigned>::max()), 
 	        origX(0), origY(0), stepX(0), stepY(0), numSites(0), siteorient("") {}
   void print();
 };
 
+/* an input file held in memory and split into tokens up front, so that     */
+/* several files can be tokenized concurrently (see read_iccad2014_file)   */
+/* .gz/.bz2/.zst files and <archive>.tar[.gz|.bz2|.zst]:<member> are       */
+/* streamed through an external decompressor while being tokenized        */
+struct token_stream
+{
+  string name;                 /* file name */
+  bool valid;                  /* was the file readable? */
+  vector<char> buffer;         /* file contents; token ends are overwritten by '\0' */
+  vector<unsigned> tokens;     /* offsets of the tokens into buffer */
+  vector<unsigned> lines;      /* index of the first token of each non-empty line (line mode) */
+  unsigned pos;                /* next token to be read */
+  unsigned line;               /* next line to be read (line mode) */
+
+  token_stream() : name(""), valid(false), pos(0), line(0) {}
+  void load(const string &input, const char* beginComment, bool lineMode);
+  size_t scan(size_t begin, bool lastChunk, const char* beginComment, bool lineMode, bool &lineBegin);
+  bool good() const { return valid; }
+  bool eof() const { return pos >= tokens.size(); }
+  const char* next() { return &buffer[ tokens[pos++] ]; }
+};
+
+struct net_box
+{
+  double lx, hx;              /* low/high x of the net's pins (in DBU) */
+  double ly, hy;              /* low/high y of the net's pins (in DBU) */
+  unsigned nlx, nhx;          /* number of pins on the low/high x boundary */
+  unsigned nly, nhy;          /* number of pins on the low/high y boundary */
+};
+
+struct cell_move
+{
+  unsigned cell;              /* cell index */
+  int x_coord, y_coord;       /* new location (in DBU) */
+};
+
 struct density_bin
 {
   double lx, hx;              /* low/high x coordinate */
@@ -201,18 +408,65 @@ struct density_bin
   double free_space;          /* bin's freespace area */
 };
 
+struct density_window
+{
+  double movable;             /* movable cell area in the window */
+  double fixed;               /* fixed cell area in the window */
+  double free_space;          /* row site area not taken by fixed cells */
+};
+
+struct legality_entry
+{
+  int y, x;                   /* lower left of the cell, or of a row slice (in DBU) */
+  int width;                  /* (in DBU) */
+  unsigned id;                /* cell id */
+};
+
+struct legality_line
+{
+  int y;                                /* (in DBU) */
+  vector<unsigned> rows;                /* the rows at this y, left to right; none off the rows */
+  set< pair<int, unsigned> > slices;    /* (x, cell id) of the cells on this line */
+};
+
+struct abacus_cluster
+{
+  unsigned first;             /* first cell of the cluster in abacus_segment::cells */
+  double e, q;                /* total weight & weighted sum of the optimal x (in sites) */
+  int w;                      /* width (in sites) */
+  int x;                      /* leftmost site */
+};
+
+struct abacus_segment
+{
+  int y, origX, stepX;        /* y & site 0 (in DBU) */
+  int numSites, used;         /* free sites & those taken so far */
+  vector<unsigned> cells;     /* cells placed in the segment, left to right */
+  vector<abacus_cluster> clusters;
+};
+
+struct dct_plan
+{
+  unsigned size;                           /* transform length N (a power of 2) */
+  vector<unsigned> bitrev;                 /* bit reversal of the 2N-point FFT */
+  vector< complex<double> > twiddle;       /* exp(-2 pi i k / 2N), k < N */
+  vector< complex<double> > shift;         /* exp(-i pi u / 2N), u < N */
+};
+
 class circuit
 {
   private:
     string benchmark;               /* benchmark name */
 		string directory;
-    map<string, unsigned> macro2id; /* map between macro name and ID */
-    map<string, unsigned> cell2id;  /* map between cell  name and ID */
-    map<string, unsigned> pin2id;   /* map between pin   name and ID */
-    map<string, unsigned> net2id;   /* map between net   name and ID */
-    map<string, unsigned> row2id;   /* map between row   name and ID */
-    map<string, unsigned> site2id;  /* map between site  name and ID */
-    map<string, unsigned> layer2id; /* map between layer name and ID */
+    arena object_arena;             /* backs the tables below, the pin/cell/net/row names & the */
+                                    /* per cell/net lists; freed at once with the circuit       */
+    name_map macro2id;              /* map between macro name and ID */
+    name_map cell2id;               /* map between cell  name and ID */
+    name_map pin2id;                /* map between pin   name and ID */
+    name_map net2id;                /* map between net   name and ID */
+    name_map row2id;                /* map between row   name and ID */
+    name_map site2id;               /* map between site  name and ID */
+    name_map layer2id;              /* map between layer name and ID */
 
 		unsigned num_fixed_nodes; 
     double total_mArea;             /* total movable cell area */
@@ -253,6 +507,34 @@ class circuit
     vector<pin> pins;              /* pin list */
     vector<row> rows;              /* row list */
 
+    /* hot geometry, kept apart from the cell/pin structs as parallel arrays */
+    vector<int> cell_x, cell_y;          /* cell locations, by cell id (in DBU) */
+    vector<unsigned> pin_owner;          /* owner cell, by pin id; max() for PIs/POs */
+    vector<double> pin_xoff, pin_yoff;   /* COG of VIA relative to the owner's origin (in DBU) */
+    vector<double> pin_x, pin_y;         /* pin locations, by pin id (in DBU) */
+
+    /* connectivity in compressed sparse row form, built once after parsing */
+    vector<unsigned> net_pin_start;      /* pins of net n : net_pins[ net_pin_start[n] .. net_pin_start[n+1] ) */
+    vector<unsigned> net_pins;           /* per net, the source first & then the sinks */
+    vector<unsigned> cell_net_start;     /* nets of cell c : cell_nets[ cell_net_start[c] .. cell_net_start[c+1] ) */
+    vector<unsigned> cell_nets;          /* each net is listed once per cell */
+    vector<unsigned> cell_pin_start;     /* connected pins of cell c : cell_pins[ cell_pin_start[c] .. cell_pin_start[c+1] ) */
+    vector<unsigned> cell_pins;          /* in net order */
+
+    /* nets bucketed by degree for measure_HPWL; pin k of the i-th net of a bucket  */
+    /* is at [k*(number of nets in the bucket) + i]. single-pin nets are left out */
+    vector<unsigned> deg2_pins;          /* pins of the 2-pin nets */
+    vector<unsigned> deg3_pins;          /* pins of the 3-pin nets */
+    vector<unsigned> degN_nets;          /* the nets with more than three pins */
+
+    /* incremental HPWL (see init_HPWL) */
+    vector<net_box> net_boxes;           /* cached bounding box of each net */
+    double HPWL_dbu;                     /* sum of the net_boxes' half perimeters (in DBU) */
+    vector<unsigned> net_stamp;          /* last move_cells() call that touched each net */
+    unsigned move_stamp;
+    vector<unsigned> touched_nets;       /* nets touched by the current move_cells() call */
+    vector<double> touched_HPWL;         /* & their HPWL before the call */
+
     vector<unsigned> PIs;          /* PI pin list (by id) */
     vector<unsigned> POs;          /* PO pin list (by id) */
 
@@ -266,48 +548,159 @@ class circuit
     layer* locateOrCreateLayer(const string &layerName);
 
     /* IO helper for verilog */
-    bool read_module(ifstream &is, string &moduleName);
-    bool read_primary_input(ifstream &is, string &primaryInput);
-    bool read_primary_output(ifstream &is, string &primaryOutput);
-    bool read_wire(ifstream &is, string &wire);
-    bool read_cell_inst(ifstream &is, string &cellType, string &cellInstName, 
+    bool read_module(token_stream &is, string &moduleName);
+    bool read_primary_input(token_stream &is, string &primaryInput);
+    bool read_primary_output(token_stream &is, string &primaryOutput);
+    bool read_wire(token_stream &is, string &wire);
+    bool read_cell_inst(token_stream &is, string &cellType, string &cellInstName, 
                         vector<pair<string, string> > &pinNetPairs);
 
     /* IO helper for SDC */
-    bool read_clock(ifstream &is, string &clockName, string &clockPort, double &period);
-    bool read_input_delay(ifstream &is, string &portName, double &delay);
-    bool read_output_delay(ifstream &is, string &portName, double &delay);
-    bool read_driver_info(ifstream &is, string &inPortName, string &driverType, string &driverPin,
+    bool read_clock(token_stream &is, string &clockName, string &clockPort, double &period);
+    bool read_input_delay(token_stream &is, string &portName, double &delay);
+    bool read_output_delay(token_stream &is, string &portName, double &delay);
+    bool read_driver_info(token_stream &is, string &inPortName, string &driverType, string &driverPin,
                           double &inputTransitionFall, double &inputTransitionRise);
-    bool read_output_load(ifstream &is, string &outPortName, double &load);
+    bool read_output_load(token_stream &is, string &outPortName, double &load);
 
     /* IO helpers for LEF */
-    void read_lef_site(ifstream &is);
-    void read_lef_layer(ifstream &is);
-    void read_lef_macro(ifstream &is);
-    void read_lef_macro_site(ifstream &is, macro* myMacro);
-    void read_lef_macro_pin(ifstream &is, macro* myMacro);
+    void read_lef_site(token_stream &is);
+    void read_lef_layer(token_stream &is);
+    void read_lef_macro(token_stream &is);
+    void read_lef_macro_site(token_stream &is, macro* myMacro);
+    void read_lef_macro_pin(token_stream &is, macro* myMacro);
 
     /* IO helpers for DEF */
-    void read_init_def_components(ifstream &is);
-    void read_final_def_components(ifstream &is);
-    void read_def_pins(ifstream &is);
-    void read_def_nets(ifstream &is);
-    void create_rows();
+    void read_init_def_components(token_stream &is);
+    void read_final_def_components(token_stream &is);
+    void read_def_pins(token_stream &is);
+    void read_def_nets(token_stream &is);
+    void create_rows(bool init_or_final);
+    void build_connectivity();
+
+    /* IO helper for bookshelf */
+    unsigned read_bookshelf_pl_lines(const char* text, size_t begin, size_t end);
 
 		/* for timing evaluation */
     void update_pinlocs();
     void build_steiner();
     void slice_longwires(unsigned threshold);
+    string wire_node_name(const net &theNet, unsigned node);
+
+    /* for incremental HPWL */
+    void rescan_net_box(unsigned theNet);
+    bool move_pin_in_box(net_box &box, double oldX, double oldY, double newX, double newY);
+
+    /* for incremental density (see init_density) */
+    vector<density_bin> density_bins;   /* free_space excludes the fixed area */
+    vector<double> bin_util;            /* utilization per bin, 0 if left out */
+    double density_unit, density_targUt;
+    int density_xnum, density_ynum, density_skipped;
+    vector<long long> density_xEdge, density_yEdge;  /* bin edges, rounded to DBU (see density_edges) */
+    multiset<double> top_utils, rest_utils;  /* the top 20% of bin_util & the others */
+    unsigned top_size;                       /* 0 if not tracked (see init_top_utils) */
+
+    void build_density_bins(vector<density_bin> &bins, double gridUnit, int x_gridNum, int y_gridNum);
+    void init_density_bins(vector<density_bin> &bins, double gridUnit, int x_gridNum, int y_gridNum);
+    void sum_density_areas(const vector<density_bin> &bins, double gridUnit, int x_gridNum, int y_gridNum, 
+                           vector<long long> &area);
+    void density_edges(const vector<density_bin> &bins, int x_gridNum, int y_gridNum, 
+                       vector<long long> &xEdge, vector<long long> &yEdge);
+    void add_cell_to_bins(vector<density_bin> &bins, const vector<long long> &xEdge, const vector<long long> &yEdge, 
+                          double gridUnit, unsigned i, int x, int y, double sign);
+    double ABU_from_utils(vector<double> &util_array, int skipped_bin_cnt, double targUt, bool verbose);
+    double ABU_from_top(const vector<double> &top, int numCounted, double targUt, bool verbose);
+    void move_cell_density(unsigned c, int oldX, int oldY);
+    void update_top_utils(double oldUtil, double newUtil);
+
+    /* for window density queries (see init_density_sat) */
+    vector<long long> sat_site, sat_fixed;   /* summed-area tables, (xnum+1) x (ynum+1) */
+    vector<long long> sat_movable;           /* a summed-area or a Fenwick table */
+    vector<long long> sat_xEdge, sat_yEdge;  /* base bin edges (in DBU) */
+    double sat_unit;                         /* base bin width (in DBU) */
+    bool sat_fenwick;
+    vector< pair<unsigned, long long> > sat_pending;  /* moved area not yet in the summed-area table, by entry */
+    unsigned sat_pending_max;                /* pending entries before they are folded into the table */
+
+    long long sat_prefix(const vector<long long> &table, bool fenwick, int i, int j);
+    double sat_corner(const vector<long long> &table, bool fenwick, int i, int j, double fx, double fy);
+    void add_cell_sat(unsigned c, int x, int y, long long sign);
+    void flush_sat_pending();
+
+    /* for density plots, written in the background */
+    unsigned plot_format, plot_frame;
+    string plot_prefix;
+    thread plot_writer;
+
+    void start_density_plot(const vector<double> &util_array, const vector<density_bin> &bins, int x_gridNum, int y_gridNum);
+
+    /* for the electrostatic density (see init_electro) */
+    int electro_xnum, electro_ynum;          /* bins (powers of 2) */
+    double electro_binW, electro_binH;       /* bin size (in DBU) */
+    unsigned electro_threads;
+    dct_plan electro_xplan, electro_yplan;
+    vector<double> electro_rho, electro_psi, electro_ex, electro_ey;  /* density, potential & field per bin */
+    vector< vector<double> > electro_partial;               /* per-thread density grids */
+    vector< vector< complex<double> > > electro_work;       /* per-thread FFT buffers */
+
+    void electro_overlaps(unsigned i, vector< pair<unsigned, double> > &overlaps);
+    void electro_transform(vector<double> &grid, unsigned xtype, unsigned ytype);
+
+    /* for legality checks */
+    vector<unsigned> unrowed_cells;          /* cells on no row (see create_rows) */
+    void check_row_legality(int y, const vector<unsigned> &lineCells, unsigned first, unsigned last, 
+                            const vector<unsigned> &rowOrder, unsigned errors[6], ostringstream logs[6]);
+    void legality_by_rows(unsigned errors[6], string* logs);
+
+    /* for incremental legality (see init_legality) */
+    vector<legality_line> legal_lines;
+    map<int, unsigned> legal_line_at;        /* y -> legal_lines index */
+    vector<unsigned char> legal_flags;       /* ILLEGAL_TYPE 1,2,3,4 & 6 per cell, bit k for TYPE k+1 */
+    vector<unsigned> legal_counts;           /* violations per ILLEGAL_TYPE, empty if not tracked */
+
+    unsigned char cell_legal_flags(unsigned c, int x, int y);
+    bool slices_overlap(const pair<int, unsigned> &left, const pair<int, unsigned> &right);
+    void add_cell_legality(unsigned c, int x, int y, int sign);
+
+    /* for the site map (see init_site_map) */
+    vector<unsigned long long> site_words;   /* one bit per row site, set if taken */
+    vector<unsigned long long> site_fixed;   /* the sites taken by fixed cells */
+    vector<unsigned> site_word_start;        /* first word of each row, rows+1 entries */
+    map<int, vector<unsigned> > site_rows_at;   /* y -> rows, left to right */
+    vector<int> site_line_y;                    /* the y of the rows, ascending */
+
+    /* for legalization (see legalize) */
+    vector<abacus_segment> abacus_segs;      /* free row segments, by line & then x */
+    vector<unsigned> abacus_line_start;      /* first segment of each line, lines+1 entries */
+    vector<int> abacus_line_y;               /* y of each line (in DBU) */
+
+    bool find_free_spot(unsigned c, int &x, int &y, double budget);
+    bool abacus_place(unsigned c, unsigned firstLine, unsigned lastLine);
+    vector<unsigned> abacus_replace(const vector<unsigned> &extra, unsigned firstLine, unsigned lastLine);
+    bool shift_into_row(unsigned c, double budget, map<int, map<int, unsigned> > &placed);
+    bool initial_site_row(unsigned c, unsigned &r, int &site);
+    bool return_to_initial(unsigned c, double budget, map<int, map<int, unsigned> > &placed, vector<unsigned> &unplaced);
+    void apply_legal_moves(const vector<cell_move> &moves);
+
+    /* for smooth wirelength models */
+    double smooth_WL_nets(unsigned model, double gamma, unsigned firstNet, unsigned lastNet, double* grad_x, double* grad_y);
 
   public:
-    circuit(): num_fixed_nodes(0), 
+    circuit(): macro2id(&object_arena), cell2id(&object_arena), 
+               pin2id(&object_arena), net2id(&object_arena), 
+               row2id(&object_arena), site2id(&object_arena), 
+               layer2id(&object_arena), 
+               num_fixed_nodes(0), 
 		           LOCAL_WIRE_CAP_PER_MICRON(0.20e-15), LOCAL_WIRE_RES_PER_MICRON(0.60), 
 	             GLOBAL_WIRE_CAP_PER_MICRON(0.20e-15), GLOBAL_WIRE_RES_PER_MICRON(0.10),
 	             MAX_WIRE_SEGMENT_IN_MICRON(20.0),
 							 DEFVersion(""), DEFDelimiter("/"), DEFBusCharacters("[]"), 
-               design_name(""), DEFdist2Microns(0), total_HPWL(1e8), total_StWL(1e8), 
+               design_name(""), DEFdist2Microns(0), HPWL_dbu(0.0), move_stamp(0), 
+               density_unit(0.0), density_targUt(1.0), density_xnum(0), density_ynum(0), density_skipped(0), top_size(0), sat_unit(0.0), sat_fenwick(false), sat_pending_max(0), plot_format(PLOT_NONE), plot_frame(0), 
+               electro_xnum(0), electro_ynum(0), electro_binW(0.0), electro_binH(0.0), electro_threads(1), 
+               total_HPWL(1e8), total_StWL(1e8), 
                ABU_penalty(100.0), displacement(0.0) {}
+    ~circuit() { wait_density_plot(); }
 
     /* placer */
     void doStuff();
@@ -319,21 +712,55 @@ class circuit
     void read_sdc(const string &input);
     void read_lef(const string &input);
     void read_def(const string &input, bool init_or_final);
+    void read_verilog(token_stream &is);
+    void read_sdc(token_stream &is);
+    void read_lef(token_stream &is);
+    void read_def(token_stream &is, bool init_or_final);
 		void copy_init_to_final();
 
     void measure_HPWL();
+    void init_HPWL();
+    double move_cells(const vector<cell_move> &moves);
+    double measure_smooth_WL(unsigned model, double gamma, vector<double> &grad_x, vector<double> &grad_y);
     void measure_ABU(double bin_dim, double targUt);
+    vector<double> measure_ABU_pyramid(const vector<unsigned> &bin_dims, double targUt);
+    void init_density(double bin_dim, double targUt);
+    void init_top_utils();
+    double density_ABU();
+    void set_density_plot(unsigned format, const string &prefix);
+    void plot_density();
+    void wait_density_plot();
+    void init_electro(double unit);
+    double measure_electro(vector<double> &grad_x, vector<double> &grad_y);
+    void init_density_sat(double unit, bool fenwick);
+    density_window window_density(double x1, double y1, double x2, double y2);
     void measure_displacement();
     bool measure_timing();
 
     void print();
 		void calc_design_area_stats();
 		bool check_legality();
-		void sort_and_slice_objects();
+		unsigned legality_errors();
+		void init_legality();
+		const vector<unsigned>& legality_counts() { return legal_counts; }
+		unsigned move_violations(unsigned c, int x, int y);
+
+		/* site map */
+		void init_site_map();
+		void mark_sites(unsigned c, int x, int y, bool occupied);
+		bool sites_free(unsigned r, int first, int numSites);
+		int find_free_sites(unsigned r, int numSites, int site, bool rightward);
+		int nearest_free_sites(unsigned r, int numSites, int site);
+
+		/* legalizer */
+		unsigned legalize();
+		vector<unsigned> legalize_bounded(double max_displ);
 
 		/* benchmark generation */
 		void write_bookshelf();
 		void convert_pl_to_def(const string thePlacer, const string Identifier);
+		void write_def(const string &output);
+		void read_bookshelf_pl(const string &input);
 
     /* evaluation related variables */
     double clock_period;            /* (in sec) */
@@ -343,8 +770,18 @@ class circuit
 };
 
 bool is_special_char(char c);
+void run_threads(unsigned numThreads, const function<void(unsigned)> &job);
+void add_rect_to_grid(long long* grid, unsigned slot, const vector<long long> &xEdge, const vector<long long> &yEdge, 
+		double gridLx, double gridBy, double gridUnit, long long x1, long long y1, long long x2, long long y2);
+string strip_compression_suffix(const string &input);
+string decompress_command(const string &input);
+FILE* open_input(const string &input, bool &isPipe);
+bool close_input(FILE* fp, bool isPipe);
 bool read_line_as_tokens(istream &is, vector<string> &tokens);
 void get_next_token(ifstream &is, string &token, const char* beginComment);
 void get_next_n_tokens(ifstream &is, vector<string> &tokens, const unsigned n, const char* beginComment);
+bool read_line_as_tokens(token_stream &is, vector<string> &tokens);
+void get_next_token(token_stream &is, string &token, const char* beginComment);
+void get_next_n_tokens(token_stream &is, vector<string> &tokens, const unsigned n, const char* beginComment);
 //#endif
 
@@ -0,0 +1,979 @@
+/*----------------------------------------------------------------------------------*/
+/*  Desc:     Functions to find legal places for cells on the circuit rows          */
+/*                                                                                  */
+/*            The site map holds one bit per row site, set if the site is taken    */
+/*            by a (fixed or movable) cell; free runs of sites are found a word    */
+/*            (64 sites) at a time, or four words at a time with AVX2              */
+/*----------------------------------------------------------------------------------*/
+
+#include "evaluate.h"
+
+// NOTE: as in evaluate.cpp, the AVX2 scans are picked at run time
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && !defined(NO_AVX2)
+#define LEGALIZE_AVX2
+#include <immintrin.h>
+#endif
+
+#define ALL_SITES (~0ULL)
+
+#ifdef LEGALIZE_AVX2
+/* ************************************************************************ */
+/*  Desc: AVX2 bodies of skip_words(), four words at a time; return the     */
+/*        first (last, going left) word index where a block of four is not */
+/*        all equal to value, the remainder is left to the scalar loop      */
+/* ************************************************************************ */
+__attribute__((target("avx2")))
+static int skip_words_right_avx2(const unsigned long long* words, int i, int numWords, unsigned long long value)
+{
+	const __m256i all = _mm256_set1_epi64x((long long)value);
+	for( ; i+4 <= numWords ; i+=4)
+	{
+		__m256i block = _mm256_loadu_si256((const __m256i*)(words+i));
+		if(_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(block, all))) != 0xF)
+			break;
+	}
+	return i;
+}
+
+__attribute__((target("avx2")))
+static int skip_words_left_avx2(const unsigned long long* words, int i, unsigned long long value)
+{
+	const __m256i all = _mm256_set1_epi64x((long long)value);
+	for( ; i >= 3 ; i-=4)
+	{
+		__m256i block = _mm256_loadu_si256((const __m256i*)(words+i-3));
+		if(_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(block, all))) != 0xF)
+			break;
+	}
+	return i;
+}
+#endif
+
+/* ********************************************************************* */
+/*  Desc: the first word at or right of i (rightward), or at or left of  */
+/*        i, that differs from value; numWords (-1) if there is none     */
+/* ********************************************************************* */
+static int skip_words(const unsigned long long* words, int i, int numWords, unsigned long long value, bool rightward)
+{
+#ifdef LEGALIZE_AVX2
+	if(__builtin_cpu_supports("avx2"))
+		i = rightward ? skip_words_right_avx2(words, i, numWords, value) : skip_words_left_avx2(words, i, value);
+#endif
+	if(rightward)
+		while(i < numWords && words[i] == value)
+			i++;
+	else
+		while(i >= 0 && words[i] == value)
+			i--;
+	return i;
+}
+
+/* ******************************************************************** */
+/*  Desc: the first site at or right of pos whose bit is bit; numWords */
+/*        *64 if there is none                                          */
+/* ******************************************************************** */
+static int next_site(const unsigned long long* words, int numWords, int pos, bool bit)
+{
+	int i = pos >> 6;
+	if(i >= numWords)
+		return numWords*64;
+	unsigned long long flip = bit ? 0ULL : ALL_SITES;
+	unsigned long long theWord = (words[i] ^ flip) & (ALL_SITES << (pos & 63));
+	if(theWord == 0)
+	{
+		i = skip_words(words, i+1, numWords, flip, true);
+		if(i >= numWords)
+			return numWords*64;
+		theWord = words[i] ^ flip;
+	}
+	return i*64 + __builtin_ctzll(theWord);
+}
+
+/* ************************************************************* */
+/*  Desc: the last site at or left of pos whose bit is bit; -1   */
+/*        if there is none                                       */
+/* ************************************************************* */
+static int prev_site(const unsigned long long* words, int pos, bool bit)
+{
+	if(pos < 0)
+		return -1;
+	int i = pos >> 6;
+	unsigned long long flip = bit ? 0ULL : ALL_SITES;
+	unsigned long long theWord = (words[i] ^ flip) & (ALL_SITES >> (63 - (pos & 63)));
+	if(theWord == 0)
+	{
+		i = skip_words(words, i-1, 0, flip, false);
+		if(i < 0)
+			return -1;
+		theWord = words[i] ^ flip;
+	}
+	return i*64 + 63 - __builtin_clzll(theWord);
+}
+
+/* ********************************************************************** */
+/*  Desc: build the site map of each row from the current placement.      */
+/*        a site is taken if any part of it is covered by a cell; bits    */
+/*        past the last site of a row are always set. move_cells() keeps */
+/*        the map up to date from then on                                 */
+/* ********************************************************************** */
+void circuit::init_site_map()
+{
+	site_rows_at.clear();
+	site_word_start.assign(rows.size()+1, 0);
+	for(unsigned r=0 ; r<rows.size() ; r++)
+	{
+		site_rows_at[ rows[r].origY ].push_back(r);
+		site_word_start[r+1] = site_word_start[r] + (rows[r].numSites + 63)/64;
+	}
+	site_line_y.clear();
+	for(map<int, vector<unsigned> >::iterator it = site_rows_at.begin() ; it != site_rows_at.end() ; ++it)
+	{
+		sort(it->second.begin(), it->second.end(), [this](unsigned a, unsigned b) { return rows[a].origX < rows[b].origX; });
+		site_line_y.push_back(it->first);
+	}
+
+	site_fixed.assign(site_word_start.back(), 0);
+	for(unsigned r=0 ; r<rows.size() ; r++)
+		if(rows[r].numSites % 64 != 0)
+			site_fixed[ site_word_start[r+1]-1 ] = ALL_SITES << (rows[r].numSites % 64);
+	site_words = site_fixed;
+
+	// NOTE: fixed cells first, so that their sites stay taken when a movable cell leaves them
+	for(unsigned i=0 ; i<cells.size() ; i++)
+		if(cells[i].isFixed)
+			mark_sites(i, cell_x[i], cell_y[i], true);
+	site_fixed = site_words;
+	for(unsigned i=0 ; i<cells.size() ; i++)
+		if(!cells[i].isFixed)
+			mark_sites(i, cell_x[i], cell_y[i], true);
+	return;
+}
+
+/* ************************************************************************ */
+/*  Desc: take (occupied) or release the sites of cell c at (x,y), on all   */
+/*        the rows it overlaps; sites of fixed cells are never released.   */
+/*        O(w/64) per row. assumes c did not share its sites with another  */
+/*        movable cell, as in a legal placement                             */
+/* ************************************************************************ */
+void circuit::mark_sites(unsigned c, int x, int y, bool occupied)
+{
+	int rowH = (int)rowHeight;
+	map<int, vector<unsigned> >::iterator it = site_rows_at.upper_bound(y - rowH);
+	for( ; it != site_rows_at.end() && it->first < y + cells[c].height ; ++it)
+		for(unsigned k=0 ; k<it->second.size() ; k++)
+		{
+			row *theRow = &rows[ it->second[k] ];
+			int first = (int)floor((double)(x - theRow->origX) / theRow->stepX);
+			int last = (int)ceil((x + cells[c].width - theRow->origX) / theRow->stepX) - 1;
+			first = max(first, 0);
+			last = min(last, theRow->numSites-1);
+			if(first > last)
+				continue;
+
+			unsigned long long* words = &site_words[ site_word_start[ it->second[k] ] ];
+			const unsigned long long* fixed = &site_fixed[ site_word_start[ it->second[k] ] ];
+			for(int w = first >> 6 ; w <= (last >> 6) ; w++)
+			{
+				unsigned long long mask = ALL_SITES;
+				if(w == (first >> 6))
+					mask &= ALL_SITES << (first & 63);
+				if(w == (last >> 6))
+					mask &= ALL_SITES >> (63 - (last & 63));
+				if(occupied)
+					words[w] |= mask;
+				else
+					words[w] = (words[w] & ~mask) | (fixed[w] & mask);
+			}
+		}
+	return;
+}
+
+/* ******************************************************************** */
+/*  Desc: are the sites first .. first+numSites-1 of row r all free?    */
+/* ******************************************************************** */
+bool circuit::sites_free(unsigned r, int first, int numSites)
+{
+	if(first < 0 || first + numSites > rows[r].numSites)
+		return false;
+	const unsigned long long* words = &site_words[ site_word_start[r] ];
+	return next_site(words, site_word_start[r+1] - site_word_start[r], first, true) >= first + numSites;
+}
+
+/* ************************************************************************ */
+/*  Desc: the first site of the nearest run of numSites free sites in row  */
+/*        r that starts at or right of site (rightward), or at or left of  */
+/*        it; -1 if there is none. each step skips a whole run of taken or */
+/*        free sites, a word at a time                                     */
+/* ************************************************************************ */
+int circuit::find_free_sites(unsigned r, int numSites, int site, bool rightward)
+{
+	const unsigned long long* words = &site_words[ site_word_start[r] ];
+	int numWords = site_word_start[r+1] - site_word_start[r];
+	int lastStart = rows[r].numSites - numSites;
+	if(numSites <= 0 || lastStart < 0)
+		return -1;
+
+	if(rightward)
+	{
+		int pos = max(site, 0);
+		while(pos <= lastStart)
+		{
+			int begin = next_site(words, numWords, pos, false);
+			if(begin > lastStart)
+				return -1;
+			int end = next_site(words, numWords, begin, true);
+			if(end - begin >= numSites)
+				return begin;
+			pos = end;
+		}
+		return -1;
+	}
+
+	int pos = min(site, lastStart) + numSites - 1;
+	while(pos >= numSites - 1)
+	{
+		int end = prev_site(words, pos, false);
+		if(end < numSites - 1)
+			return -1;
+		int begin = prev_site(words, end, true);
+		if(end - begin >= numSites)
+			return end - numSites + 1;
+		pos = begin;
+	}
+	return -1;
+}
+
+/* ******************************************************************* */
+/*  Desc: the first site of the run of numSites free sites in row r    */
+/*        closest to site, either side; -1 if there is none            */
+/* ******************************************************************* */
+int circuit::nearest_free_sites(unsigned r, int numSites, int site)
+{
+	int right = find_free_sites(r, numSites, site, true);
+	int left = find_free_sites(r, numSites, site, false);
+	if(left < 0 || (right >= 0 && right - site < site - left))
+		return right;
+	return left;
+}
+
+/* the sites taken by a cell of the given width (in DBU) */
+static int sites_for(double width, int stepX)
+{
+	return ((int)llround(width) + stepX - 1) / stepX;
+}
+
+/* ************************************************************************ */
+/*  Desc: the nearest place (in Manhattan distance) for the lower left of   */
+/*        cell c at (x,y), where all its sites are free in the site map;   */
+/*        false if there is none. with a budget >= 0 (in DBU), only places */
+/*        within that distance of its initial place are tried. the rows a  */
+/*        multi-row cell spans must have the same site grid                */
+/* ************************************************************************ */
+bool circuit::find_free_spot(unsigned c, int &x, int &y, double budget)
+{
+	int rowH = (int)rowHeight;
+	int numRows = max(((int)llround(cells[c].height) + rowH - 1) / rowH, 1);
+	const vector<int> &lineY = site_line_y;
+
+	double best = numeric_limits<double>::max();
+	int bestX = x, bestY = y;
+	int mid = lower_bound(lineY.begin(), lineY.end(), y) - lineY.begin();
+	for(unsigned pass=0 ; pass<2 ; pass++)
+		for(int l = pass ? mid : mid-1 ; l >= 0 && l < (int)lineY.size() ; l += pass ? 1 : -1)
+		{
+			double dy = fabs((double)(lineY[l] - y));
+			if(dy >= best)
+				break;
+			double slack = budget - fabs((double)(lineY[l] - cells[c].init_y_coord));
+			if(budget >= 0.0 && slack < 0.0)
+				continue;
+			const vector<unsigned> &lineRows = site_rows_at[ lineY[l] ];
+			for(unsigned k=0 ; k<lineRows.size() ; k++)
+			{
+				row *theRow = &rows[ lineRows[k] ];
+				vector<unsigned> above;
+				for(int n=1 ; n<numRows ; n++)
+				{
+					map<int, vector<unsigned> >::iterator it = site_rows_at.find(lineY[l] + n*rowH);
+					if(it == site_rows_at.end())
+						break;
+					for(unsigned m=0 ; m<it->second.size() ; m++)
+						if(rows[ it->second[m] ].origX == theRow->origX && rows[ it->second[m] ].stepX == theRow->stepX)
+							above.push_back(it->second[m]);
+					if((int)above.size() != n)
+						break;
+				}
+				if((int)above.size() != numRows-1)
+					continue;
+
+				/* the sites the cell may start at */
+				int w = sites_for(cells[c].width, theRow->stepX);
+				int lo = 0, hi = theRow->numSites - w;
+				if(budget >= 0.0)
+				{
+					lo = max(lo, (int)ceil((cells[c].init_x_coord - slack - theRow->origX) / theRow->stepX));
+					hi = min(hi, (int)floor((cells[c].init_x_coord + slack - theRow->origX) / theRow->stepX));
+				}
+				if(lo > hi)
+					continue;
+				int site = min(max((int)floor((double)(x - theRow->origX) / theRow->stepX), lo), hi);
+				for(unsigned dir=0 ; dir<2 ; dir++)
+				{
+					// NOTE: a bounded number of tries, each skipping to the next free run of the lowest row
+					int s = find_free_sites(lineRows[k], w, site, dir == 1);
+					for(unsigned tries=0 ; s >= lo && s <= hi && tries < 64 ; tries++)
+					{
+						double dx = fabs((double)(theRow->origX + s*theRow->stepX - x));
+						if(dx + dy >= best)
+							break;
+						bool fits = true;
+						for(unsigned n=0 ; n<above.size() && fits ; n++)
+							fits = sites_free(above[n], s, w);
+						if(fits)
+						{
+							best = dx + dy;
+							bestX = theRow->origX + s*theRow->stepX;
+							bestY = lineY[l];
+							break;
+						}
+						s = find_free_sites(lineRows[k], w, dir == 1 ? s+1 : s-1, dir == 1);
+					}
+				}
+			}
+		}
+	if(best == numeric_limits<double>::max())
+		return false;
+	x = bestX;
+	y = bestY;
+	return true;
+}
+
+/* the best site for a cluster of weight e, weighted optimal sum q & width w */
+static int cluster_site(double e, double q, int w, int numSites)
+{
+	return min(max((int)floor(q/e + 0.5), 0), numSites - w);
+}
+
+/* ************************************************************************ */
+/*  Desc: the site a cell of width w with optimal site xs would get if it  */
+/*        were added at the right end of seg; seg is left as it is         */
+/* ************************************************************************ */
+static int abacus_trial(const abacus_segment &seg, double xs, int w)
+{
+	double e = 1.0, q = xs;
+	int width = w, offset = 0;
+	int x = cluster_site(e, q, width, seg.numSites);
+	for(int k = (int)seg.clusters.size()-1 ; k >= 0 ; k--)
+	{
+		const abacus_cluster &prev = seg.clusters[k];
+		if(prev.x + prev.w <= x)
+			break;
+		q = prev.q + q - e*prev.w;
+		e += prev.e;
+		offset += prev.w;
+		width += prev.w;
+		x = cluster_site(e, q, width, seg.numSites);
+	}
+	return x + offset;
+}
+
+/* ************************************************************************ */
+/*  Desc: add cell c (width w, optimal site xs) at the right end of seg &  */
+/*        merge its cluster with the ones on its left while they overlap  */
+/* ************************************************************************ */
+static void abacus_add(abacus_segment &seg, unsigned c, double xs, int w)
+{
+	abacus_cluster theCluster;
+	theCluster.first = seg.cells.size();
+	theCluster.e = 1.0;
+	theCluster.q = xs;
+	theCluster.w = w;
+	theCluster.x = cluster_site(theCluster.e, theCluster.q, w, seg.numSites);
+	seg.cells.push_back(c);
+	seg.used += w;
+	seg.clusters.push_back(theCluster);
+	while(seg.clusters.size() > 1)
+	{
+		abacus_cluster &last = seg.clusters.back(), &prev = seg.clusters[ seg.clusters.size()-2 ];
+		if(prev.x + prev.w <= last.x)
+			break;
+		prev.q += last.q - last.e*prev.w;
+		prev.e += last.e;
+		prev.w += last.w;
+		prev.x = cluster_site(prev.e, prev.q, prev.w, seg.numSites);
+		seg.clusters.pop_back();
+	}
+	return;
+}
+
+/* ************************************************************************* */
+/*  Desc: put cell c in the segment of lines firstLine .. lastLine-1 where   */
+/*        it moves the least (squared distance), trying the lines outward   */
+/*        from its y while they can still do better. false if no segment   */
+/*        has room for it                                                   */
+/* ************************************************************************* */
+bool circuit::abacus_place(unsigned c, unsigned firstLine, unsigned lastLine)
+{
+	double x = cell_x[c], y = cell_y[c];
+	double bestCost = numeric_limits<double>::max();
+	int bestSeg = -1;
+	int mid = lower_bound(abacus_line_y.begin()+firstLine, abacus_line_y.begin()+lastLine, cell_y[c]) - abacus_line_y.begin();
+	for(unsigned pass=0 ; pass<2 ; pass++)
+		for(int l = pass ? mid : mid-1 ; l >= (int)firstLine && l < (int)lastLine ; l += pass ? 1 : -1)
+		{
+			double dy = abacus_line_y[l] - y;
+			if(dy*dy >= bestCost)
+				break;
+
+			/* the segments left of x (from the one it falls in), then right of it */
+			int first = abacus_line_start[l], last = abacus_line_start[l+1];
+			int s0 = first;
+			while(s0 < last && abacus_segs[s0].origX <= x)
+				s0++;
+			for(unsigned side=0 ; side<2 ; side++)
+				for(int s = side ? s0 : s0-1 ; s >= first && s < last ; s += side ? 1 : -1)
+				{
+					abacus_segment &seg = abacus_segs[s];
+					int w = sites_for(cells[c].width, seg.stepX);
+					double dx = side ? seg.origX - x : x + w*seg.stepX - (seg.origX + seg.numSites*seg.stepX);
+					if(dx > 0 && dx*dx + dy*dy >= bestCost)
+						break;
+					if(seg.used + w > seg.numSites)
+						continue;
+					int site = abacus_trial(seg, (x - seg.origX)/seg.stepX, w);
+					dx = seg.origX + site*seg.stepX - x;
+					if(dx*dx + dy*dy < bestCost)
+					{
+						bestCost = dx*dx + dy*dy;
+						bestSeg = s;
+					}
+				}
+		}
+	if(bestSeg < 0)
+		return false;
+
+	abacus_segment &seg = abacus_segs[bestSeg];
+	abacus_add(seg, c, (x - seg.origX)/seg.stepX, sites_for(cells[c].width, seg.stepX));
+	return true;
+}
+
+/* ************************************************************************* */
+/*  Desc: place the cells of lines firstLine .. lastLine-1 again, along with */
+/*        the extra cells, all in x order, so that the extra ones go in     */
+/*        between the others rather than at a segment's right end. returns */
+/*        the cells that did not fit                                       */
+/* ************************************************************************* */
+vector<unsigned> circuit::abacus_replace(const vector<unsigned> &extra, unsigned firstLine, unsigned lastLine)
+{
+	vector<unsigned> order(extra), failed;
+	for(unsigned s = abacus_line_start[firstLine] ; s < abacus_line_start[lastLine] ; s++)
+	{
+		abacus_segment &seg = abacus_segs[s];
+		order.insert(order.end(), seg.cells.begin(), seg.cells.end());
+		seg.cells.clear();
+		seg.clusters.clear();
+		seg.used = 0;
+	}
+	sort(order.begin(), order.end(), [this](unsigned a, unsigned b) {
+		return (cell_x[a] < cell_x[b]) || (cell_x[a] == cell_x[b] && a < b); });
+	for(unsigned k=0 ; k<order.size() ; k++)
+		if(!abacus_place(order[k], firstLine, lastLine))
+			failed.push_back(order[k]);
+	return failed;
+}
+
+/* ********************************************************************* */
+/*  Desc: move the cells to their legal places, through move_cells() if  */
+/*        any incremental structure is kept; rebuilds the site map       */
+/* ********************************************************************* */
+void circuit::apply_legal_moves(const vector<cell_move> &moves)
+{
+	// NOTE: the site map is rebuilt, as releasing the sites of overlapping cells one by one would be wrong
+	site_words.clear();
+	if(net_boxes.size() == nets.size() || !density_bins.empty() || !sat_movable.empty() || !legal_counts.empty())
+		move_cells(moves);
+	else
+		for(unsigned k=0 ; k<moves.size() ; k++)
+		{
+			cell_x[ moves[k].cell ] = moves[k].x_coord;
+			cell_y[ moves[k].cell ] = moves[k].y_coord;
+		}
+	init_site_map();
+	return;
+}
+
+/* ************************************************************************* */
+/*  Desc: move the movable cells to legal places, near their current ones:  */
+/*        multi-row cells first (nearest free spot in the site map), then   */
+/*        Abacus on the free row segments left by fixed & multi-row cells,  */
+/*        in bands of LEGAL_BAND_LINES row lines on a pool of threads.      */
+/*        the lines around each band boundary are then packed again, and   */
+/*        cells that do not fit in their band are placed again with        */
+/*        the neighbouring bands, the window doubling until they fit.      */
+/*        returns the number of cells that could not be placed (left where */
+/*        they were)                                                        */
+/* ************************************************************************* */
+unsigned circuit::legalize()
+{
+  cout << endl << "Legalizing the placement .." <<endl;
+  cout << "-------------------------------------------------------------------------------" <<endl;
+	init_site_map();
+	site_words = site_fixed;
+
+	vector<unsigned> order, multirow, unplaced;
+	for(unsigned i=0 ; i<cells.size() ; i++)
+		if(!cells[i].isFixed)
+		{
+			if(cells[i].height > rowHeight)
+				multirow.push_back(i);
+			else
+				order.push_back(i);
+		}
+	sort(order.begin(), order.end(), [this](unsigned a, unsigned b) {
+		return (cell_x[a] < cell_x[b]) || (cell_x[a] == cell_x[b] && a < b); });
+
+	vector<cell_move> moves;
+	for(unsigned k=0 ; k<multirow.size() ; k++)
+	{
+		cell_move theMove;
+		theMove.cell = multirow[k];
+		theMove.x_coord = cell_x[ multirow[k] ];
+		theMove.y_coord = cell_y[ multirow[k] ];
+		if(!find_free_spot(theMove.cell, theMove.x_coord, theMove.y_coord, -1.0))
+		{
+			unplaced.push_back(theMove.cell);
+			continue;
+		}
+		mark_sites(theMove.cell, theMove.x_coord, theMove.y_coord, true);
+		moves.push_back(theMove);
+	}
+
+	/* the free segments of each row line */
+	abacus_segs.clear();
+	abacus_line_start.assign(1, 0);
+	abacus_line_y.clear();
+	for(map<int, vector<unsigned> >::iterator it = site_rows_at.begin() ; it != site_rows_at.end() ; ++it)
+	{
+		abacus_line_y.push_back(it->first);
+		for(unsigned k=0 ; k<it->second.size() ; k++)
+		{
+			unsigned r = it->second[k];
+			const unsigned long long* words = &site_words[ site_word_start[r] ];
+			int numWords = site_word_start[r+1] - site_word_start[r];
+			for(int begin = next_site(words, numWords, 0, false) ; begin < rows[r].numSites ; )
+			{
+				int end = next_site(words, numWords, begin, true);
+				abacus_segment theSeg;
+				theSeg.y = it->first;
+				theSeg.origX = rows[r].origX + begin*rows[r].stepX;
+				theSeg.stepX = rows[r].stepX;
+				theSeg.numSites = end - begin;
+				theSeg.used = 0;
+				abacus_segs.push_back(theSeg);
+				begin = next_site(words, numWords, end, false);
+			}
+		}
+		abacus_line_start.push_back(abacus_segs.size());
+	}
+
+	/* each cell goes to the band of its nearest line; bands are handed out one at a time */
+	unsigned numLines = abacus_line_y.size();
+	unsigned numBands = (numLines + LEGAL_BAND_LINES - 1) / LEGAL_BAND_LINES;
+	vector< vector<unsigned> > bandCells(numBands), bandFailed(numBands), seamCells(numBands);
+	vector<unsigned> nearestLine(cells.size(), 0);
+	for(unsigned k=0 ; k<order.size() && numLines > 0 ; k++)
+	{
+		unsigned l = lower_bound(abacus_line_y.begin(), abacus_line_y.end(), cell_y[ order[k] ]) - abacus_line_y.begin();
+		if(l == numLines || (l > 0 && cell_y[ order[k] ] - abacus_line_y[l-1] < abacus_line_y[l] - cell_y[ order[k] ]))
+			l--;
+		nearestLine[ order[k] ] = l;
+		bandCells[l / LEGAL_BAND_LINES].push_back(order[k]);
+	}
+	atomic<unsigned> nextBand(0);
+	unsigned numThreads = max(1u, thread::hardware_concurrency());
+	numThreads = min(numThreads, max(numBands, 1u));
+	run_threads(numThreads, [&](unsigned t) {
+		for(unsigned b = nextBand++ ; b < numBands ; b = nextBand++)
+		{
+			unsigned firstLine = b*LEGAL_BAND_LINES, lastLine = min(numLines, firstLine + LEGAL_BAND_LINES);
+			for(unsigned k=0 ; k<bandCells[b].size() ; k++)
+				if(!abacus_place(bandCells[b][k], firstLine, lastLine))
+					bandFailed[b].push_back(bandCells[b][k]);
+		}
+	});
+
+	/* the half bands on either side of each band boundary (seam s, between bands s-1 & s) are packed again together,
+	   with the cells that did not fit and whose nearest line is in them, so that they can cross the boundary */
+	unsigned spilled = 0;
+	for(unsigned b=0 ; b<numBands ; b++)
+	{
+		spilled += bandFailed[b].size();
+		vector<unsigned> kept;
+		for(unsigned k=0 ; k<bandFailed[b].size() ; k++)
+		{
+			unsigned s = (nearestLine[ bandFailed[b][k] ] + LEGAL_BAND_LINES/2) / LEGAL_BAND_LINES;
+			if(s > 0 && s < numBands)
+				seamCells[s].push_back(bandFailed[b][k]);
+			else
+				kept.push_back(bandFailed[b][k]);
+		}
+		bandFailed[b].swap(kept);
+	}
+	atomic<unsigned> nextSeam(1);
+	run_threads(numThreads, [&](unsigned t) {
+		for(unsigned s = nextSeam++ ; s < numBands ; s = nextSeam++)
+			seamCells[s] = abacus_replace(seamCells[s], s*LEGAL_BAND_LINES - LEGAL_BAND_LINES/2, min(numLines, s*LEGAL_BAND_LINES + LEGAL_BAND_LINES/2));
+	});
+	for(unsigned s=1 ; s<numBands ; s++)
+		for(unsigned k=0 ; k<seamCells[s].size() ; k++)
+			bandFailed[ nearestLine[ seamCells[s][k] ] / LEGAL_BAND_LINES ].push_back(seamCells[s][k]);
+
+	for(unsigned b=0 ; b<numBands ; b++)
+	{
+		vector<unsigned> pending(bandFailed[b]);
+		for(unsigned radius=1 ; !pending.empty() ; radius *= 2)
+		{
+			unsigned firstBand = (b > radius) ? b - radius : 0, lastBand = min(numBands, b + radius + 1);
+			pending = abacus_replace(pending, firstBand*LEGAL_BAND_LINES, min(numLines, lastBand*LEGAL_BAND_LINES));
+			if(firstBand == 0 && lastBand == numBands)
+				break;
+		}
+		unplaced.insert(unplaced.end(), pending.begin(), pending.end());
+	}
+	if(numLines == 0)
+		unplaced.insert(unplaced.end(), order.begin(), order.end());
+
+	for(unsigned s=0 ; s<abacus_segs.size() ; s++)
+	{
+		const abacus_segment &seg = abacus_segs[s];
+		for(unsigned k=0 ; k<seg.clusters.size() ; k++)
+		{
+			unsigned last = (k+1 < seg.clusters.size()) ? seg.clusters[k+1].first : seg.cells.size();
+			int site = seg.clusters[k].x;
+			for(unsigned n = seg.clusters[k].first ; n < last ; n++)
+			{
+				cell_move theMove;
+				theMove.cell = seg.cells[n];
+				theMove.x_coord = seg.origX + site*seg.stepX;
+				theMove.y_coord = seg.y;
+				moves.push_back(theMove);
+				site += sites_for(cells[ seg.cells[n] ].width, seg.stepX);
+			}
+		}
+	}
+
+	double totalDispl = 0.0, maxDispl = 0.0;
+	for(unsigned k=0 ; k<moves.size() ; k++)
+	{
+		double displ = fabs((double)(moves[k].x_coord - cell_x[ moves[k].cell ])) + fabs((double)(moves[k].y_coord - cell_y[ moves[k].cell ]));
+		totalDispl += displ;
+		maxDispl = max(maxDispl, displ);
+	}
+
+	apply_legal_moves(moves);
+
+	cout << "  row bands       : "<< numBands << " ( "<< LEGAL_BAND_LINES << " lines, "<< numThreads << " threads, "<< spilled << " cells spilled )" <<endl;
+	cout << "  cells placed    : "<< moves.size() << " ( "<< multirow.size() << " multi-row )" <<endl;
+	cout << "  displacement    : avg "<< (moves.empty() ? 0.0 : totalDispl / moves.size() / DEFdist2Microns) 
+	     << " um, max "<< maxDispl / DEFdist2Microns << " um" <<endl;
+	if(!unplaced.empty())
+		cout << "  WARNING: "<< unplaced.size() << " cells could not be placed" <<endl;
+	return unplaced.size();
+}
+
+/* ************************************************************************* */
+/*  Desc: make room for single-row cell c within its displacement budget    */
+/*        (in DBU) by shifting the cells placed on a row, each within its  */
+/*        own budget. the cells of a window around the range c may start  */
+/*        in are packed again in x order, as close to where they were as  */
+/*        possible; the first line (nearest to c) & window where this     */
+/*        works is taken. placed holds the x of the placed cells per line */
+/* ************************************************************************* */
+bool circuit::shift_into_row(unsigned c, double budget, map<int, map<int, unsigned> > &placed)
+{
+	vector< pair<int, int> > lines;     /* (distance to c, y) */
+	for(map<int, vector<unsigned> >::iterator it = site_rows_at.begin() ; it != site_rows_at.end() ; ++it)
+		if(fabs((double)(it->first - cells[c].init_y_coord)) <= budget)
+			lines.push_back(make_pair(abs(it->first - cell_y[c]), it->first));
+	sort(lines.begin(), lines.end());
+
+	for(unsigned l=0 ; l<lines.size() ; l++)
+	{
+		int y = lines[l].second;
+		const vector<unsigned> &lineRows = site_rows_at[y];
+		map<int, unsigned> &lineCells = placed[y];
+		for(unsigned k=0 ; k<lineRows.size() ; k++)
+		{
+			row *theRow = &rows[ lineRows[k] ];
+			int w = sites_for(cells[c].width, theRow->stepX);
+			double slack = budget - fabs((double)(y - cells[c].init_y_coord));
+			int lo = max(0, (int)ceil((cells[c].init_x_coord - slack - theRow->origX) / theRow->stepX));
+			int hi = min(theRow->numSites - w, (int)floor((cells[c].init_x_coord + slack - theRow->origX) / theRow->stepX));
+			if(lo > hi)
+				continue;
+
+			/* each run of sites free of fixed cells that c may start in */
+			const unsigned long long* fixed = &site_fixed[ site_word_start[ lineRows[k] ] ];
+			int numWords = site_word_start[ lineRows[k]+1 ] - site_word_start[ lineRows[k] ];
+			for(int a = next_site(fixed, numWords, prev_site(fixed, lo, true)+1, false) ; a <= hi ; )
+			{
+				int b = next_site(fixed, numWords, a, true);
+				int A = max(a, lo - LEGAL_SHIFT_SITES), B = min(b, hi + w + LEGAL_SHIFT_SITES);
+				a = next_site(fixed, numWords, b, false);
+
+				/* the window stops at the cells crossing its ends */
+				int xA = theRow->origX + A*theRow->stepX, xB = theRow->origX + B*theRow->stepX;
+				map<int, unsigned>::iterator it = lineCells.lower_bound(xA);
+				if(it != lineCells.begin())
+				{
+					map<int, unsigned>::iterator prev = it;
+					--prev;
+					if(prev->first + cells[prev->second].width > xA)
+						A = (int)ceil((prev->first + cells[prev->second].width - theRow->origX) / theRow->stepX);
+				}
+				vector<unsigned> ids;
+				vector<int> oldX;
+				for( ; it != lineCells.end() && it->first < xB ; ++it)
+				{
+					if(it->first + cells[it->second].width > xB)
+					{
+						B = (it->first - theRow->origX) / theRow->stepX;
+						break;
+					}
+					ids.push_back(it->second);
+					oldX.push_back(it->first);
+				}
+				if(max(A, lo) > min(B - w, hi))
+					continue;
+
+				/* the range, width & site of each cell, c in x order among them */
+				int site = (int)floor((double)(cell_x[c] - theRow->origX) / theRow->stepX + 0.5);
+				site = min(max(site, max(A, lo)), min(B - w, hi));
+				unsigned at = 0;
+				while(at < ids.size() && (oldX[at] - theRow->origX) / theRow->stepX <= site)
+					at++;
+				ids.insert(ids.begin() + at, c);
+				oldX.insert(oldX.begin() + at, theRow->origX + site*theRow->stepX);
+
+				unsigned num = ids.size();
+				vector<int> width(num), low(num), high(num), want(num), newSite(num);
+				for(unsigned n=0 ; n<num ; n++)
+				{
+					unsigned i = ids[n];
+					width[n] = sites_for(cells[i].width, theRow->stepX);
+					double s = budget - fabs((double)(y - cells[i].init_y_coord));
+					low[n] = max(A, (int)ceil((cells[i].init_x_coord - s - theRow->origX) / theRow->stepX));
+					high[n] = min(B - width[n], (int)floor((cells[i].init_x_coord + s - theRow->origX) / theRow->stepX));
+					want[n] = (oldX[n] - theRow->origX) / theRow->stepX;
+				}
+
+				// NOTE: leftmost packing first (feasible iff it fits), then each cell as close to where it was as the next one allows
+				bool fits = true;
+				for(unsigned n=0, next=A ; n<num && fits ; n++)
+				{
+					newSite[n] = max(low[n], (int)next);
+					fits = (newSite[n] <= high[n]);
+					next = newSite[n] + width[n];
+				}
+				if(!fits)
+					continue;
+				for(int n=num-1, next=B ; n>=0 ; n--)
+				{
+					newSite[n] = min(min(max(newSite[n], want[n]), high[n]), next - width[n]);
+					next = newSite[n];
+				}
+
+				for(unsigned n=0 ; n<num ; n++)
+					if(ids[n] != c)
+					{
+						mark_sites(ids[n], oldX[n], y, false);
+						lineCells.erase(oldX[n]);
+					}
+				for(unsigned n=0 ; n<num ; n++)
+				{
+					int newX = theRow->origX + newSite[n]*theRow->stepX;
+					mark_sites(ids[n], newX, y, true);
+					lineCells[newX] = ids[n];
+				}
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+/* ********************************************************************* */
+/*  Desc: the row & site of the initial place of single-row cell c;     */
+/*        false if it is not on the sites of a row, or if fixed (or     */
+/*        multi-row, see legalize_bounded) cells take any of them       */
+/* ********************************************************************* */
+bool circuit::initial_site_row(unsigned c, unsigned &r, int &site)
+{
+	map<int, vector<unsigned> >::iterator it = site_rows_at.find(cells[c].init_y_coord);
+	if(it == site_rows_at.end())
+		return false;
+	for(unsigned k=0 ; k<it->second.size() ; k++)
+	{
+		row *theRow = &rows[ it->second[k] ];
+		int offset = cells[c].init_x_coord - theRow->origX;
+		int w = sites_for(cells[c].width, theRow->stepX);
+		if(offset < 0 || offset % theRow->stepX != 0 || offset/theRow->stepX + w > theRow->numSites)
+			continue;
+		r = it->second[k];
+		site = offset/theRow->stepX;
+		const unsigned long long* fixed = &site_fixed[ site_word_start[r] ];
+		return next_site(fixed, site_word_start[r+1] - site_word_start[r], site, true) >= site + w;
+	}
+	return false;
+}
+
+/* ************************************************************************* */
+/*  Desc: put single-row cell c on its initial place, which is always within */
+/*        budget. the cells placed there are moved to the nearest free spot */
+/*        within their own budget, else to their initial places in turn.    */
+/*        a cell on its initial place is never moved by this, so each cell  */
+/*        goes back at most once if the initial places do not overlap.     */
+/*        cells left without a place go to unplaced; false if c is one     */
+/* ************************************************************************* */
+bool circuit::return_to_initial(unsigned c, double budget, map<int, map<int, unsigned> > &placed, vector<unsigned> &unplaced)
+{
+	vector<unsigned> pending(1, c);
+	while(!pending.empty())
+	{
+		unsigned i = pending.back();
+		pending.pop_back();
+		unsigned r;
+		int site;
+		bool free = initial_site_row(i, r, site);
+
+		/* the cells in the way, none of them on its own initial place */
+		int x = cells[i].init_x_coord, y = cells[i].init_y_coord;
+		map<int, unsigned> &lineCells = placed[y];
+		map<int, unsigned>::iterator first = lineCells.lower_bound(x), last = first;
+		if(first != lineCells.begin())
+		{
+			--first;
+			if(first->first + cells[first->second].width <= x)
+				++first;
+		}
+		while(last != lineCells.end() && last->first < x + cells[i].width)
+			++last;
+		for(map<int, unsigned>::iterator it = first ; it != last && free ; ++it)
+			free = (it->first != cells[it->second].init_x_coord || y != cells[it->second].init_y_coord);
+		if(!free)
+		{
+			unplaced.push_back(i);
+			if(i == c)
+				return false;
+			continue;
+		}
+
+		vector<unsigned> evicted;
+		for(map<int, unsigned>::iterator it = first ; it != last ; ++it)
+		{
+			evicted.push_back(it->second);
+			mark_sites(it->second, it->first, y, false);
+		}
+		lineCells.erase(first, last);
+		mark_sites(i, x, y, true);
+		lineCells[x] = i;
+
+		for(unsigned k=0 ; k<evicted.size() ; k++)
+		{
+			int newX = cell_x[ evicted[k] ], newY = cell_y[ evicted[k] ];
+			if(find_free_spot(evicted[k], newX, newY, budget))
+			{
+				mark_sites(evicted[k], newX, newY, true);
+				placed[newY][newX] = evicted[k];
+			}
+			else
+				pending.push_back(evicted[k]);
+		}
+	}
+	return true;
+}
+
+/* ************************************************************************* */
+/*  Desc: move the movable cells to legal places within max_displ (in um,   */
+/*        Manhattan) of their initial ones, as measure_displacement() has  */
+/*        it, near their current ones: the nearest free spot inside that   */
+/*        diamond, else room made by shifting the cells of a row, else    */
+/*        its initial place, moving the cells there (single-row cells     */
+/*        only, see return_to_initial). taller cells go first & are not  */
+/*        moved again. cells that cannot be placed are left where they    */
+/*        were & returned                                                 */
+/* ************************************************************************* */
+vector<unsigned> circuit::legalize_bounded(double max_displ)
+{
+  cout << endl << "Legalizing the placement within "<< max_displ << " um .." <<endl;
+  cout << "-------------------------------------------------------------------------------" <<endl;
+	double budget = max_displ * DEFdist2Microns;
+	init_site_map();
+	site_words = site_fixed;
+
+	vector<unsigned> order, unplaced;
+	for(unsigned i=0 ; i<cells.size() ; i++)
+		if(!cells[i].isFixed)
+			order.push_back(i);
+	sort(order.begin(), order.end(), [this](unsigned a, unsigned b) {
+		if(cells[a].height != cells[b].height)
+			return cells[a].height > cells[b].height;
+		return (cell_x[a] < cell_x[b]) || (cell_x[a] == cell_x[b] && a < b); });
+
+	map<int, map<int, unsigned> > placed;   /* single-row cells, y -> x -> cell */
+	vector<cell_move> moves;
+	unsigned shifted = 0, returned = 0;
+	bool multirow = true;
+	for(unsigned k=0 ; k<order.size() ; k++)
+	{
+		unsigned c = order[k];
+		bool single = (cells[c].height <= rowHeight);
+		// NOTE: multi-row cells, once placed, are kept like fixed ones
+		if(single && multirow)
+		{
+			site_fixed = site_words;
+			multirow = false;
+		}
+		cell_move theMove;
+		theMove.cell = c;
+		theMove.x_coord = cell_x[c];
+		theMove.y_coord = cell_y[c];
+		if(find_free_spot(c, theMove.x_coord, theMove.y_coord, budget))
+		{
+			mark_sites(c, theMove.x_coord, theMove.y_coord, true);
+			if(single)
+				placed[ theMove.y_coord ][ theMove.x_coord ] = c;
+			else
+				moves.push_back(theMove);
+		}
+		else if(single && shift_into_row(c, budget, placed))
+			shifted++;
+		else if(single && return_to_initial(c, budget, placed, unplaced))
+			returned++;
+		else if(!single)
+			unplaced.push_back(c);
+	}
+	for(map<int, map<int, unsigned> >::iterator line = placed.begin() ; line != placed.end() ; ++line)
+		for(map<int, unsigned>::iterator it = line->second.begin() ; it != line->second.end() ; ++it)
+		{
+			cell_move theMove;
+			theMove.cell = it->second;
+			theMove.x_coord = it->first;
+			theMove.y_coord = line->first;
+			moves.push_back(theMove);
+		}
+	apply_legal_moves(moves);
+	measure_displacement();
+
+	cout << "  cells placed    : "<< moves.size() << " ( "<< shifted << " by shifting others, "<< returned << " returned to their initial place )" <<endl;
+	cout << "  max displacement: "<< displacement << " um" <<endl;
+	if(!unplaced.empty())
+	{
+		cout << "  WARNING: "<< unplaced.size() << " cells could not be placed within "<< max_displ << " um" <<endl;
+		for(unsigned k=0 ; k<unplaced.size() && k<20 ; k++)
+			cout << "    " << cells[ unplaced[k] ].name << " (" << cell_x[ unplaced[k] ] << ", " << cell_y[ unplaced[k] ] << ")" <<endl;
+		if(unplaced.size() > 20)
+			cout << "    .." <<endl;
+	}
+	return unplaced;
+}
@@ -19,7 +19,7 @@ int main(int argc, char** argv)
   if(argc != 4 && argc != 5)
   {
     cout << "Incorrect arguments. exiting .."<<endl;
-    cout << "Usage : iccad2014_evaluation ICCAD14.parm [.iccad2014] [target_util] (optional)[final .def]" << endl ;
+    cout << "Usage : iccad2014_evaluation ICCAD14.parm [.iccad2014] [target_util] (optional)[final .def or .pl]" << endl ;
     return 0;
   }
 	cout << "Command line : " << endl;
@@ -35,14 +35,20 @@ int main(int argc, char** argv)
 	string Identifier = "-ComPLx";
 	ckt.write_bookshelf();
 	// insert command line to run the placer 
-	ckt.convert_pl_to_def(AcademicPlacer, Identifier);
-	string final_def=benchmark+"_"+AcademicPlacer+".def";
-	ckt.read_def(final_def, FINAL);
+	string benchmark(argv[2]);
+	benchmark = strip_compression_suffix(benchmark.substr(benchmark.find_last_of("/\\")+1));
+	benchmark = benchmark.substr(0, benchmark.find_last_of("."));
+	ckt.read_bookshelf_pl(benchmark+Identifier+".pl");
 #else
 	if(argc == 5)
 	{
-		string final_def(argv[4]);
-		ckt.read_def(final_def, FINAL);
+		string final_placement(argv[4]);
+		string plainname = strip_compression_suffix(final_placement);
+		// NOTE: a bookshelf .pl is applied directly, anything else is read as a .def
+		if(plainname.size() > 3 && plainname.substr(plainname.size()-3) == ".pl")
+			ckt.read_bookshelf_pl(final_placement);
+		else
+			ckt.read_def(final_placement, FINAL);
 	}
 	else
 		ckt.copy_init_to_final();
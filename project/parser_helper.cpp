@@ -20,30 +20,9 @@ inline bool operator<(const row &a, const row &b)
 	return (a.origY < b.origY) || (a.origY == b.origY && a.origX < b.origX);
 }
 
-/* ************************************************************************* */
-/*  Desc: update pin locations based on owner cell locations & pin offsets   */
-/* ************************************************************************* */
-void circuit::update_pinlocs()
-{
-	for(vector<pin>::iterator thePin = pins.begin() ; thePin != pins.end() ; ++thePin)
-	{
-		if(thePin->isFixed || thePin->owner == numeric_limits<unsigned>::max())
-		{
-			thePin->x_coord = thePin->x_coord + thePin->x_offset;
-			thePin->y_coord = thePin->y_coord + thePin->y_offset;
-		}
-		else
-		{
-			thePin->x_coord = cells[ thePin->owner ].x_coord + thePin->x_offset;
-			thePin->y_coord = cells[ thePin->owner ].y_coord + thePin->y_offset;
-		}
-	}
-  return;
-}
-
 void circuit::doStuff(){
   update_pinlocs();
-  int i=0;
+  unsigned i=0;
   //for(unsigned i=0; i<cells.size(); i++){
   //if(cells[i].isFixed){
       //cout<<"fixed"<<endl;
@@ -52,56 +31,45 @@ void circuit::doStuff(){
   //cells[i].print();
   //cout<<endl;
   
-    net myNet;
-    cell myCell;
     vector<double> X, Y;
     double xopt_l, xopt_r, yopt_t, yopt_b;
-    double minX,minY,maxX,maxY;
-    for (map<string, unsigned>::iterator it=cells[i].ports.begin() ; it!=cells[i].ports.end() ; it++){
-      //cout<<"port: "<<(*it).first<<" - "<<(*it).second<<endl;
-      //pins[(*it).second].print();
-      myNet = nets[pins[(*it).second].net];
-      //myNet.print();
-      //cout<<endl;
-
-      int index=0;
-      if(myNet.source != (*it).second){
-	index=myNet.source;
-      }
-      else{
-	index=myNet.sinks[0];
-      }
-
-      if(pins[index].owner == UINT_MAX){
-	minX=maxX=pins[index].x_coord;
-	minY=maxY=pins[index].y_coord;
-      }
-      else{
-	myCell = cells[pins[index].owner];
-	minX=(double)myCell.x_coord;
-	maxX=(double)(myCell.x_coord+myCell.width);
-	minY=(double)myCell.y_coord;
-	maxY=(double)(myCell.y_coord+myCell.height);
-      }
-      
-      for(vector<unsigned>::iterator thePin=myNet.sinks.begin() ; thePin != myNet.sinks.end() ; ++thePin){
-	if(*thePin == (*it).second)
+    double minX=0.0,minY=0.0,maxX=0.0,maxY=0.0;
+    X.reserve(2*(cell_net_start[i+1]-cell_net_start[i]));
+    Y.reserve(2*(cell_net_start[i+1]-cell_net_start[i]));
+    // bounding box of each net of the cell, excluding the cell itself
+    for (unsigned n=cell_net_start[i] ; n<cell_net_start[i+1] ; n++){
+      unsigned theNet=cell_nets[n];
+      bool empty=true;
+      for(unsigned p=net_pin_start[theNet] ; p<net_pin_start[theNet+1] ; p++){
+	unsigned thePin=net_pins[p];
+	unsigned owner=pin_owner[thePin];
+	if(owner == i)
 	  continue;
-	
-	if(pins[*thePin].owner == UINT_MAX){
-	  maxX=max(maxX,pins[*thePin].x_coord);
-	  minX=min(minX,pins[*thePin].x_coord);
-	  maxY=max(maxY,pins[*thePin].y_coord);
-	  minY=min(minY,pins[*thePin].y_coord);
+
+	double lx, hx, ly, hy;
+	if(owner == UINT_MAX){
+	  lx=hx=pin_x[thePin];
+	  ly=hy=pin_y[thePin];
+	}
+	else{
+	  lx=(double)cell_x[owner];
+	  hx=(double)(cell_x[owner]+cells[owner].width);
+	  ly=(double)cell_y[owner];
+	  hy=(double)(cell_y[owner]+cells[owner].height);
+	}
+	if(empty){
+	  minX=lx; maxX=hx; minY=ly; maxY=hy;
+	  empty=false;
 	}
 	else{
-	  myCell = cells[pins[*thePin].owner];
-	  maxX=max(maxX, (double)(myCell.x_coord+myCell.width));
-	  minX=min(minX, (double)myCell.x_coord);
-	  maxY=max(maxY, (double)(myCell.y_coord+myCell.height));
-	  minY=min(minY, (double)myCell.y_coord);
+	  maxX=max(maxX,hx);
+	  minX=min(minX,lx);
+	  maxY=max(maxY,hy);
+	  minY=min(minY,ly);
 	}
       }
+      if(empty)
+	continue;
       X.push_back(minX);
       X.push_back(maxX);
       Y.push_back(minY);
@@ -112,6 +80,10 @@ void circuit::doStuff(){
       cout<<X[j]<<" "<<Y[j]<<" "<<endl;
       }*/
     //}
+
+  // whatever was moved above, hand back a legal placement
+  legalize();
+  check_legality();
   return;
 }
 
@@ -162,7 +134,7 @@ void circuit::read_parameters(const char* input)
 void circuit::read_iccad2014_file(const char* input)
 {
   cout << endl << "Reading .iccad2014 file .." <<endl;
-	benchmark.assign(input);
+	benchmark.assign(strip_compression_suffix(input));
   size_t found=benchmark.find_last_of("/\\");
   if(found==benchmark.npos)
   {
@@ -181,7 +153,8 @@ void circuit::read_iccad2014_file(const char* input)
   cout << "  .iccad2014 file : "<< input <<endl;
   cout << "-------------------------------------------------------------------------------" <<endl;
 	
-  ifstream dot_iccad2014(input);
+  token_stream dot_iccad2014;
+  dot_iccad2014.load(input, NULL, false);
   if (!dot_iccad2014.good())
   {
     cerr << "read_iccad2014_file:: cannot open `" << input << "' for reading." << endl;
@@ -190,10 +163,11 @@ void circuit::read_iccad2014_file(const char* input)
 
 	string dot_verilog, dot_sdc, dot_lef, dot_def;
   string filename;
-	dot_iccad2014 >> filename;
 	while (!dot_iccad2014.eof())
   {
-      string ext = filename.substr(filename.find_last_of("."));
+      filename = dot_iccad2014.next();
+      string plainname = strip_compression_suffix(filename);
+      string ext = plainname.substr(plainname.find_last_of("."));
       if (ext == ".v")
 				dot_verilog = directory+filename;
       else if (ext == ".sdc")
@@ -207,32 +181,174 @@ void circuit::read_iccad2014_file(const char* input)
         cerr << "read_iccad2014_file:: unsupported filetype is specified : " << filename << endl;
         exit(1);
       }
-			dot_iccad2014 >> filename;
   }
-  dot_iccad2014.close();
 
-	read_lef(dot_lef);
-	read_verilog(dot_verilog);
-	read_sdc(dot_sdc);
-	read_def(dot_def, INIT);
+	// NOTE: the four files are tokenized concurrently; only binding them into
+	// the circuit is order dependent (verilog needs LEF macros, SDC needs PI/PO pins,
+	// DEF needs cells & pins), so each file is bound as soon as it and its
+	// predecessors are ready, while the remaining ones are still being tokenized.
+	token_stream lef_tokens, verilog_tokens, sdc_tokens, def_tokens;
+	thread lef_loader(&token_stream::load, &lef_tokens, dot_lef, LEFCommentChar, false);
+	thread verilog_loader(&token_stream::load, &verilog_tokens, dot_verilog, (const char*)NULL, true);
+	thread sdc_loader(&token_stream::load, &sdc_tokens, dot_sdc, (const char*)NULL, true);
+	thread def_loader(&token_stream::load, &def_tokens, dot_def, DEFCommentChar, false);
+
+	lef_loader.join();
+	read_lef(lef_tokens);
+	verilog_loader.join();
+	read_verilog(verilog_tokens);
+	sdc_loader.join();
+	read_sdc(sdc_tokens);
+	def_loader.join();
+	read_def(def_tokens, INIT);
 	calc_design_area_stats();
 
 	assert(PIs.size() < MAX_PIS && POs.size() < MAX_POS);
 	
-	create_rows();
+	create_rows(INIT);
+	build_connectivity();
 	return;
 }
 
-void circuit::create_rows(){
-  int count = 0;
-  for(vector<cell>::iterator theCell=cells.begin(); theCell !=cells.end(); ++theCell){
-    theCell->row_num = theCell->init_y_coord/rowHeight;
-    rows[theCell->row_num].cells.push_back(count);
-    count++;
-  }  
-  /*for(vector<row>::iterator theRow=rows.begin(); theRow !=rows.end(); ++theRow){
-    theRow->print();
-    }*/
+/* ************************************************************************ */
+/*  Desc: bucket the cells by row, at their INIT or FINAL (current) y.     */
+/*        row::cells of the leftmost row at each y holds all the cells at  */
+/*        that y, multi-row cells once per row they span; cells whose y is */
+/*        not on any row go to unrowed_cells                               */
+/* ************************************************************************ */
+void circuit::create_rows(bool init_or_final)
+{
+	map<int, unsigned> firstRow;
+	for(unsigned r=0 ; r<rows.size() ; r++)
+	{
+		map<int, unsigned>::iterator it = firstRow.find(rows[r].origY);
+		if(it == firstRow.end() || rows[r].origX < rows[it->second].origX)
+			firstRow[ rows[r].origY ] = r;
+		rows[r].cells.clear();
+	}
+	unrowed_cells.clear();
+
+	for(unsigned i=0 ; i<cells.size() ; i++)
+	{
+		int y_coord = (init_or_final == INIT) ? cells[i].init_y_coord : cell_y[i];
+		cells[i].row_num = -1;
+		for(int y = y_coord ; y == y_coord || y < y_coord + cells[i].height ; y += (int)rowHeight)
+		{
+			map<int, unsigned>::iterator it = firstRow.find(y);
+			if(it != firstRow.end())
+			{
+				rows[it->second].cells.push_back(i);
+				if(y == y_coord)
+					cells[i].row_num = it->second;
+			}
+			else if(y == y_coord)
+				unrowed_cells.push_back(i);
+		}
+	}
+	return;
+}
+
+/* ********************************************************************* */
+/*  Desc: build the net->pins, cell->nets & cell->pins arrays (CSR) from */
+/*        the parsed nets, so that the nets of a moved cell are found in */
+/*        O(degree); also buckets the nets by degree for measure_HPWL()  */
+/* ********************************************************************* */
+void circuit::build_connectivity()
+{
+	unsigned numNets = nets.size(), numCells = cells.size();
+
+	// net -> pins, the source first
+	net_pin_start.assign(numNets+1, 0);
+	for(unsigned n=0 ; n<numNets ; n++)
+		net_pin_start[n+1] = net_pin_start[n] + nets[n].sinks.size() +
+			(nets[n].source != numeric_limits<unsigned>::max() ? 1 : 0);
+
+	net_pins.resize(net_pin_start[numNets]);
+	for(unsigned n=0 ; n<numNets ; n++)
+	{
+		unsigned k = net_pin_start[n];
+		if(nets[n].source != numeric_limits<unsigned>::max())
+			net_pins[k++] = nets[n].source;
+		for(id_list::iterator theSink=nets[n].sinks.begin() ; theSink != nets[n].sinks.end() ; ++theSink)
+			net_pins[k++] = *theSink;
+	}
+
+	// cell -> nets, counted then filled; lastNet drops a net seen twice on a cell
+	vector<unsigned> lastNet(numCells, numeric_limits<unsigned>::max());
+	cell_net_start.assign(numCells+1, 0);
+	for(unsigned n=0 ; n<numNets ; n++)
+		for(unsigned p=net_pin_start[n] ; p<net_pin_start[n+1] ; p++)
+		{
+			unsigned owner = pin_owner[ net_pins[p] ];
+			if(owner == numeric_limits<unsigned>::max() || lastNet[owner] == n)
+				continue;
+			lastNet[owner] = n;
+			cell_net_start[owner+1]++;
+		}
+	for(unsigned c=0 ; c<numCells ; c++)
+		cell_net_start[c+1] += cell_net_start[c];
+
+	cell_nets.resize(cell_net_start[numCells]);
+	vector<unsigned> fill(cell_net_start.begin(), cell_net_start.end()-1);
+	lastNet.assign(numCells, numeric_limits<unsigned>::max());
+	for(unsigned n=0 ; n<numNets ; n++)
+		for(unsigned p=net_pin_start[n] ; p<net_pin_start[n+1] ; p++)
+		{
+			unsigned owner = pin_owner[ net_pins[p] ];
+			if(owner == numeric_limits<unsigned>::max() || lastNet[owner] == n)
+				continue;
+			lastNet[owner] = n;
+			cell_nets[ fill[owner]++ ] = n;
+		}
+
+	// cell -> connected pins, in net order
+	cell_pin_start.assign(numCells+1, 0);
+	for(unsigned p=0 ; p<net_pins.size() ; p++)
+		if(pin_owner[ net_pins[p] ] != numeric_limits<unsigned>::max())
+			cell_pin_start[ pin_owner[ net_pins[p] ]+1 ]++;
+	for(unsigned c=0 ; c<numCells ; c++)
+		cell_pin_start[c+1] += cell_pin_start[c];
+
+	cell_pins.resize(cell_pin_start[numCells]);
+	fill.assign(cell_pin_start.begin(), cell_pin_start.end()-1);
+	for(unsigned p=0 ; p<net_pins.size() ; p++)
+	{
+		unsigned owner = pin_owner[ net_pins[p] ];
+		if(owner != numeric_limits<unsigned>::max())
+			cell_pins[ fill[owner]++ ] = net_pins[p];
+	}
+
+	// degree buckets, column-major so that consecutive nets are read together
+	unsigned num2=0, num3=0;
+	for(unsigned n=0 ; n<numNets ; n++)
+	{
+		unsigned degree = net_pin_start[n+1] - net_pin_start[n];
+		num2 += (degree == 2);
+		num3 += (degree == 3);
+	}
+	deg2_pins.resize(2*num2);
+	deg3_pins.resize(3*num3);
+	degN_nets.clear();
+	unsigned i2=0, i3=0;
+	for(unsigned n=0 ; n<numNets ; n++)
+	{
+		unsigned begin = net_pin_start[n], degree = net_pin_start[n+1] - begin;
+		if(degree == 2)
+		{
+			for(unsigned k=0 ; k<2 ; k++)
+				deg2_pins[k*num2 + i2] = net_pins[begin+k];
+			i2++;
+		}
+		else if(degree == 3)
+		{
+			for(unsigned k=0 ; k<3 ; k++)
+				deg3_pins[k*num3 + i3] = net_pins[begin+k];
+			i3++;
+		}
+		else if(degree > 3)
+			degN_nets.push_back(n);
+	}
+	return;
 }
 
 void circuit::calc_design_area_stats()
@@ -271,11 +387,17 @@ void circuit::calc_design_area_stats()
 
 void circuit::read_verilog(const string &input)
 {
-  cout << "  .v file         : "<< input <<endl;
-  ifstream dot_verilog(input.c_str());
+  token_stream dot_verilog;
+  dot_verilog.load(input, NULL, true);
+  read_verilog(dot_verilog);
+}
+
+void circuit::read_verilog(token_stream &dot_verilog)
+{
+  cout << "  .v file         : "<< dot_verilog.name <<endl;
   if (!dot_verilog.good())
   {
-    cerr << "read_verilog:: cannot open `" << input << "' for reading" << endl;
+    cerr << "read_verilog:: cannot open `" << dot_verilog.name << "' for reading" << endl;
     exit(1);
   }
 
@@ -305,7 +427,7 @@ void circuit::read_verilog(const string &input)
       myPin         = locateOrCreatePin(primaryInput);
       myNet         = locateOrCreateNet(primaryInput);
       myNet->source = myPin->id;
-      myPin->net    = net2id[myNet->name];
+      myPin->net    = myNet - &nets[0];
 			myPin->type   = PI_PIN;
       PIs.push_back(myPin->id);
     }
@@ -323,7 +445,7 @@ void circuit::read_verilog(const string &input)
       myPin        = locateOrCreatePin(primaryOutput);
       myNet        = locateOrCreateNet(primaryOutput);
       myNet->sinks.push_back(myPin->id);
-      myPin->net   = net2id[myNet->name];
+      myPin->net   = myNet - &nets[0];
 			myPin->type  = PO_PIN;
       POs.push_back(myPin->id);
     }
@@ -355,11 +477,13 @@ void circuit::read_verilog(const string &input)
 #ifdef DEBUG
       cout << cellType << " " << cellInst << " " ;
 #endif
+			assert(macro2id.find(cellType) != macro2id.end());
       myCell       = locateOrCreateCell(cellInst);
       myCell->type = macro2id[ cellType ];
-			myMacro      = &macros[ macro2id[ cellType ] ];
+			myMacro      = &macros[ myCell->type ];
 			myCell->width  = myMacro->width  * static_cast<double>(LEFdist2Microns);
 			myCell->height = myMacro->height * static_cast<double>(LEFdist2Microns);
+			myCell->ports.assign(myMacro->pins.size(), numeric_limits<unsigned>::max());
       for (unsigned i = 0; i < pinNetPairs.size(); ++i)
       {
 #ifdef DEBUG
@@ -375,28 +499,26 @@ void circuit::read_verilog(const string &input)
           exit(2);
         }
 
-        myCell->ports [ pinNetPairs[i].first ] = myPin->id;
+				// NOTE: macro pins are resolved to their dense index once, here
+				it = myMacro->pin2id.find(pinNetPairs[i].first);
+				assert(it != myMacro->pin2id.end());
+				myMacroPin   = &myMacro->pins[ it->second ];
+        myCell->ports [ it->second ] = myPin->id;
 
-        myPin->net   = net2id[myNet->name];
-        myPin->owner = cell2id[myCell->name];
+        myPin->net   = myNet - &nets[0];
+        pin_owner[myPin->id] = myCell - &cells[0];
 				myPin->type  = NONPIO_PIN;
-				myPin->isFlopInput = (macros[ cells[myPin->owner].type ].isFlop && 
-															macros[ cells[myPin->owner].type ].pins[ pinNetPairs[i].first ].direction == "INPUT");
-
-				assert(macro2id.find(cellType) != macro2id.end());
-				assert(macros[ macro2id[cellType] ].pins.find(pinNetPairs[i].first) != macros[ macro2id[cellType] ].pins.end());
-
-				myMacroPin   = &macros[ macro2id[ cellType ] ].pins[ pinNetPairs[i].first ];
+				myPin->isFlopInput = (myMacro->isFlop && myMacroPin->direction == "INPUT");
 
 				// NOTE : pin offsets are set to the center of the pin
-				myPin->x_offset = 0.5 * (myMacroPin->xLL + myMacroPin->xUR) * static_cast<double>(LEFdist2Microns);
-				myPin->y_offset = 0.5 * (myMacroPin->yLL + myMacroPin->yUR) * static_cast<double>(LEFdist2Microns);
+				pin_xoff[myPin->id] = 0.5 * (myMacroPin->xLL + myMacroPin->xUR) * static_cast<double>(LEFdist2Microns);
+				pin_yoff[myPin->id] = 0.5 * (myMacroPin->yLL + myMacroPin->yUR) * static_cast<double>(LEFdist2Microns);
 
         if (myMacroPin->direction != "OUTPUT" )
           myNet->sinks.push_back(myPin->id);
         else
         {
-          if(nets[net2id[pinNetPairs[i].second]].source != numeric_limits<unsigned>::max())
+          if(myNet->source != numeric_limits<unsigned>::max())
           {
             cout << "ERROR: net "<< pinNetPairs[i].second << " is driven by multiple pins! existing.. ";
             exit(3);
@@ -406,11 +528,9 @@ void circuit::read_verilog(const string &input)
       }
     }
   } while (valid);
-
-  dot_verilog.close();
 }
 
-bool circuit::read_module(ifstream &is, string &moduleName)
+bool circuit::read_module(token_stream &is, string &moduleName)
 {
   vector<string> tokens;
   bool valid = read_line_as_tokens(is, tokens);
@@ -436,7 +556,7 @@ bool circuit::read_module(ifstream &is, string &moduleName)
   return valid;
 }
 
-bool circuit::read_primary_input(ifstream &is, string &primaryInput)
+bool circuit::read_primary_input(token_stream &is, string &primaryInput)
 {
   primaryInput = "";
   
@@ -459,7 +579,7 @@ bool circuit::read_primary_input(ifstream &is, string &primaryInput)
   return valid; 
 }
 
-bool circuit::read_primary_output(ifstream &is, string &primaryOutput)
+bool circuit::read_primary_output(token_stream &is, string &primaryOutput)
 {
   primaryOutput = "";
   
@@ -482,7 +602,7 @@ bool circuit::read_primary_output(ifstream &is, string &primaryOutput)
   return valid; 
 }
 
-bool circuit::read_wire(ifstream &is, string &wire)
+bool circuit::read_wire(token_stream &is, string &wire)
 {
   wire = "";
 
@@ -504,7 +624,7 @@ bool circuit::read_wire(ifstream &is, string &wire)
   return valid;
 }
 
-bool circuit::read_cell_inst(ifstream &is, string &cellType, string &cellInstName,
+bool circuit::read_cell_inst(token_stream &is, string &cellType, string &cellInstName,
                              vector<pair<string, string> > &pinNetPairs)
 {
   cellType     = "";
@@ -539,11 +659,17 @@ bool circuit::read_cell_inst(ifstream &is, string &cellType, string &cellInstNam
 
 void circuit::read_sdc(const string &input)
 {
-  cout << "  .sdc file       : "<< input <<endl;
-  ifstream dot_sdc(input.c_str());
+  token_stream dot_sdc;
+  dot_sdc.load(input, NULL, true);
+  read_sdc(dot_sdc);
+}
+
+void circuit::read_sdc(token_stream &dot_sdc)
+{
+  cout << "  .sdc file       : "<< dot_sdc.name <<endl;
   if (!dot_sdc.good())
   {
-    cerr << "read_sdc:: cannot open `" << input << "' for reading." << endl;
+    cerr << "read_sdc:: cannot open `" << dot_sdc.name << "' for reading." << endl;
     exit(1);
   }
   bool valid = read_clock(dot_sdc, clock_name, clock_port, clock_period);
@@ -614,13 +740,11 @@ void circuit::read_sdc(const string &input)
       pins[ pin2id[portName] ].cap = load * 1e-15;
     }
   } while (valid);
-
-  dot_sdc.close();
 }
 
 // Read clock definition
 // Return value indicates if the last read was successful or not.  
-bool circuit::read_clock(ifstream &is, string &clockName, string &clockPort, double &period)
+bool circuit::read_clock(token_stream &is, string &clockName, string &clockPort, double &period)
 {
   clockName = "";
   clockPort = "";
@@ -656,7 +780,7 @@ bool circuit::read_clock(ifstream &is, string &clockName, string &clockPort, dou
 
 // Read input delay
 // Return value indicates if the last read was successful or not.
-bool circuit::read_input_delay(ifstream &is, string &portName, double &delay)
+bool circuit::read_input_delay(token_stream &is, string &portName, double &delay)
 {
   portName = "";
   delay    = 0.0;
@@ -686,7 +810,7 @@ bool circuit::read_input_delay(ifstream &is, string &portName, double &delay)
 
 // Read output delay
 // Return value indicates if the last read was successful or not.
-bool circuit::read_output_delay(ifstream &is, string &portName, double &delay)
+bool circuit::read_output_delay(token_stream &is, string &portName, double &delay)
 {
   portName = "";
   delay    = 0.0;
@@ -716,7 +840,7 @@ bool circuit::read_output_delay(ifstream &is, string &portName, double &delay)
 
 // Read driver info for the input port
 // Return value indicates if the last read was successful or not.
-bool circuit::read_driver_info(ifstream &is, string &inPortName, string &driverType, string &driverPin,
+bool circuit::read_driver_info(token_stream &is, string &inPortName, string &driverType, string &driverPin,
                                double &inputTransitionFall, double &inputTransitionRise)
 {
   inPortName          = "";
@@ -762,7 +886,7 @@ bool circuit::read_driver_info(ifstream &is, string &inPortName, string &driverT
 
 // Read output load
 // Return value indicates if the last read was successful or not.  
-bool circuit::read_output_load(ifstream &is, string &outPortName, double &load)
+bool circuit::read_output_load(token_stream &is, string &outPortName, double &load)
 {
   outPortName = "";
   load        = 0.0;
@@ -789,16 +913,22 @@ bool circuit::read_output_load(ifstream &is, string &outPortName, double &load)
 }
 
 void circuit::read_def(const string &input, bool mode)
+{
+  token_stream dot_def;
+  dot_def.load(input, DEFCommentChar, false);
+  read_def(dot_def, mode);
+}
+
+void circuit::read_def(token_stream &dot_def, bool mode)
 {
 	if(mode == INIT)
-	  cout << "  .def file       : "<< input <<endl;
+	  cout << "  .def file       : "<< dot_def.name <<endl;
 	else
-		cout << "  final .def file : "<< input <<endl;
+		cout << "  final .def file : "<< dot_def.name <<endl;
 
-  ifstream dot_def(input.c_str());
   if (!dot_def.good())
   {
-    cerr << "read_def:: cannot open `" << input << "' for reading." << endl;
+    cerr << "read_def:: cannot open `" << dot_def.name << "' for reading." << endl;
     exit(1);
   }
 
@@ -879,7 +1009,6 @@ void circuit::read_def(const string &input, bool mode)
     {
       get_next_n_tokens(dot_def, tokens, 5, DEFCommentChar);
       row* myRow        = locateOrCreateRow(tokens[0]);
-      myRow->name       = tokens[0];
       myRow->site       = site2id[ tokens[1] ];
       myRow->origX      = atoi(tokens[2].c_str());
       myRow->origY      = atoi(tokens[3].c_str());
@@ -923,6 +1052,21 @@ void circuit::read_def(const string &input, bool mode)
     {
       read_def_nets(dot_def);
     }
+    else if ((tokens[0] == "PINS" || tokens[0] == "NETS") && mode == FINAL)
+    {
+      // NOTE: a final .def can be a complete one (e.g., from write_def()),
+      // but only its components are of interest here
+      string section = tokens[0];
+      while (!dot_def.eof())
+      {
+        get_next_token(dot_def, tokens[0], DEFCommentChar);
+        if (tokens[0] != "END")
+          continue;
+        get_next_token(dot_def, tokens[0], DEFCommentChar);
+        if (tokens[0] == section)
+          break;
+      }
+    }
     else if (tokens[0] == "END")
     {
       get_next_token(dot_def, tokens[0], DEFCommentChar);
@@ -930,11 +1074,10 @@ void circuit::read_def(const string &input, bool mode)
       break;
     }
   }
-  dot_def.close();
 }
 
 // assumes the COMPONENTS keyword has already been read in
-void circuit::read_init_def_components(ifstream &is)
+void circuit::read_init_def_components(token_stream &is)
 {
   cell* myCell = NULL;
   vector<string> tokens(1);
@@ -997,9 +1140,10 @@ void circuit::read_init_def_components(ifstream &is)
 }
 
 // assumes the COMPONENTS keyword has already been read in
-void circuit::read_final_def_components(ifstream &is)
+void circuit::read_final_def_components(token_stream &is)
 {
   cell* myCell = NULL;
+  unsigned myCellId = 0;
   vector<string> tokens(1);
   
   get_next_n_tokens(is, tokens, 2, DEFCommentChar);
@@ -1018,6 +1162,7 @@ void circuit::read_final_def_components(ifstream &is)
       get_next_n_tokens(is, tokens, 2, DEFCommentChar);
 			assert(cell2id.find(tokens[0]) != cell2id.end());
       myCell = locateOrCreateCell(tokens[0]);
+      myCellId = myCell - &cells[0];
     }
     else if (tokens[0] == "+")
     {
@@ -1030,8 +1175,8 @@ void circuit::read_final_def_components(ifstream &is)
         get_next_n_tokens(is, tokens, 5, DEFCommentChar);
         assert(tokens[0] == "(");
         assert(tokens[3] == ")");
-        myCell->x_coord = atoi(tokens[1].c_str());
-        myCell->y_coord = atoi(tokens[2].c_str());
+        cell_x[myCellId] = atoi(tokens[1].c_str());
+        cell_y[myCellId] = atoi(tokens[2].c_str());
         myCell->cellorient = tokens[4];
 				//NOTE: this contest does not allow flipping/rotation
 				//assert(myCell->cellorient == "N");
@@ -1053,7 +1198,7 @@ void circuit::read_final_def_components(ifstream &is)
 // assumes the PINS keyword has already been read in
 // we already read pins from .verilog, 
 // thus this update locations / performs sanity checks
-void circuit::read_def_pins(ifstream &is)
+void circuit::read_def_pins(token_stream &is)
 {
   pin* myPin = NULL;
   net* myNet = NULL;
@@ -1105,8 +1250,8 @@ void circuit::read_def_pins(ifstream &is)
         get_next_n_tokens(is, tokens, 5, DEFCommentChar);
         assert(tokens[0] == "(");
         assert(tokens[3] == ")");
-        myPin->x_coord = atof(tokens[1].c_str());
-        myPin->y_coord = atof(tokens[2].c_str());
+        pin_x[myPin->id] = atof(tokens[1].c_str());
+        pin_y[myPin->id] = atof(tokens[2].c_str());
 				// NOTE: this contest does not allow flipping/rotation
 				assert(tokens[4] == "N");
       }
@@ -1115,15 +1260,20 @@ void circuit::read_def_pins(ifstream &is)
         assert(myPin != NULL);
         get_next_token(is, tokens[0], DEFCommentChar);
 				// NOTE: we assume the layer is previously defined from .lef
-				// we don't save layer for a pin instance.
+				// the layer & shape are only kept to write them back in write_def()
 				assert(layer2id.find(tokens[0]) != layer2id.end());
+				myPin->layer = layer2id[ tokens[0] ];
         get_next_n_tokens(is, tokens, 8, DEFCommentChar);
         assert(tokens[0] == "(");
         assert(tokens[3] == ")");
         assert(tokens[4] == "(");
         assert(tokens[7] == ")");
-        myPin->x_coord += 0.5 * (atof(tokens[1].c_str()) + atof(tokens[5].c_str()));
-        myPin->y_coord += 0.5 * (atof(tokens[2].c_str()) + atof(tokens[6].c_str()));
+				myPin->xLL = atof(tokens[1].c_str());
+				myPin->yLL = atof(tokens[2].c_str());
+				myPin->xUR = atof(tokens[5].c_str());
+				myPin->yUR = atof(tokens[6].c_str());
+        pin_x[myPin->id] += 0.5 * (myPin->xLL + myPin->xUR);
+        pin_y[myPin->id] += 0.5 * (myPin->yLL + myPin->yUR);
       }
       else if (!strcmp(tokens[0].c_str(), DEFLineEndingChar))
       {
@@ -1142,7 +1292,7 @@ void circuit::read_def_pins(ifstream &is)
 // assumes the NETS keyword has already been read in
 // we already read nets from .verilog, 
 // thus this only performs sanity checks
-void circuit::read_def_nets(ifstream &is)
+void circuit::read_def_nets(token_stream &is)
 {
   net* myNet = NULL;
   pin* myPin = NULL;
@@ -1164,7 +1314,7 @@ void circuit::read_def_nets(ifstream &is)
 			// all nets should be already found in .verilog
 			assert(net2id.find(tokens[0]) != net2id.end());
       myNet = locateOrCreateNet(tokens[0]);
-      unsigned myNetId = net2id.find(myNet->name)->second;
+      unsigned myNetId = myNet - &nets[0];
 
       // first is always source, rest are sinks
       get_next_n_tokens(is, tokens, 4, DEFCommentChar);
@@ -1208,11 +1358,17 @@ void circuit::read_def_nets(ifstream &is)
 
 void circuit::read_lef(const string &input)
 {
-  cout << "  .lef file       : "<< input <<endl;
-  ifstream dot_lef(input.c_str());
+  token_stream dot_lef;
+  dot_lef.load(input, LEFCommentChar, false);
+  read_lef(dot_lef);
+}
+
+void circuit::read_lef(token_stream &dot_lef)
+{
+  cout << "  .lef file       : "<< dot_lef.name <<endl;
   if (!dot_lef.good())
   {
-    cerr << "read_lef:: cannot open `" << input << "' for reading." << endl;
+    cerr << "read_lef:: cannot open `" << dot_lef.name << "' for reading." << endl;
     exit(1);
   }
 
@@ -1302,11 +1458,10 @@ void circuit::read_lef(const string &input)
       break;
     }
   }
-  dot_lef.close();
 }
 
 // assumes the SITE keyword has already been read in
-void circuit::read_lef_site(ifstream &is)
+void circuit::read_lef_site(token_stream &is)
 {
 #ifdef DEBUG
   cerr << "read_lef_site:: begin\n" << endl;
@@ -1359,7 +1514,7 @@ void circuit::read_lef_site(ifstream &is)
 }
 
 // assumes the LAYER keyword has already been read in
-void circuit::read_lef_layer(ifstream &is)
+void circuit::read_lef_layer(token_stream &is)
 {
   layer* myLayer;
   vector<string> tokens(1);
@@ -1428,7 +1583,7 @@ void circuit::read_lef_layer(ifstream &is)
 
 
 // assumes the keyword MACRO has already been read in
-void circuit::read_lef_macro(ifstream &is)
+void circuit::read_lef_macro(token_stream &is)
 {
   macro* myMacro;
   vector<string> tokens(1);
@@ -1479,7 +1634,7 @@ void circuit::read_lef_macro(ifstream &is)
 
 
 // assumes the keyword SITE has already been read in
-void circuit::read_lef_macro_site(ifstream &is, macro* myMacro)
+void circuit::read_lef_macro_site(token_stream &is, macro* myMacro)
 {
 #ifdef DEBUG
   cerr << "read_lef_macro_site:: begin\n" << endl;
@@ -1511,7 +1666,7 @@ void circuit::read_lef_macro_site(ifstream &is, macro* myMacro)
 }
 
 // assumes the keyword PIN has already been read in
-void circuit::read_lef_macro_pin(ifstream &is, macro* myMacro)
+void circuit::read_lef_macro_pin(token_stream &is, macro* myMacro)
 {
 #ifdef DEBUG
   cerr << "read_lef_macro_pin:: begin\n" << endl;
@@ -1581,22 +1736,73 @@ void circuit::read_lef_macro_pin(ifstream &is, macro* myMacro)
   }
   get_next_token(is, tokens[0], LEFCommentChar);
   assert(pinName == tokens[0]);
-	myMacro->pins[pinName] = myPin;
+	myPin.name = pinName;
+	map<string, unsigned>::iterator it = myMacro->pin2id.find(pinName);
+	if(it == myMacro->pin2id.end())
+	{
+		myMacro->pin2id.insert(make_pair(pinName, myMacro->pins.size()));
+		myMacro->pins.push_back(myPin);
+	}
+	else
+		myMacro->pins[it->second] = myPin;
 	if(pinName == "CK")
 		myMacro->isFlop = true;
 }
 
+arena::~arena()
+{
+	for(vector<char*>::iterator theBlock=blocks.begin() ; theBlock != blocks.end() ; ++theBlock)
+		free(*theBlock);
+}
+
+void* arena::allocate(size_t bytes)
+{
+	const size_t blockSize = 1<<20;
+	// NOTE: every allocation is 16-byte aligned, enough for any type stored here
+	bytes = (bytes + 15) & ~(size_t)15;
+	if(bytes > left)
+	{
+		size_t size = max(bytes, blockSize);
+		cur = static_cast<char*>(malloc(size));
+		if(cur == NULL)
+		{
+			cerr << "arena:: out of memory" << endl;
+			exit(1);
+		}
+		blocks.push_back(cur);
+		left = size;
+	}
+	void* ptr = cur;
+	cur  += bytes;
+	left -= bytes;
+	used += bytes;
+	return ptr;
+}
+
+/* copies the name into the arena, '\0' terminated */
+name_ref intern_name(arena &pool, const string &name)
+{
+	char* str = static_cast<char*>(pool.allocate(name.size() + 1));
+	memcpy(str, name.c_str(), name.size() + 1);
+	return name_ref(str, name.size());
+}
+
 // requires full name, e.g., cell_instance/pin
 pin* circuit::locateOrCreatePin(const string &pinName)
 {
-  map<string, unsigned>::iterator it = pin2id.find(pinName);
+  name_map::iterator it = pin2id.find(pinName);
   if (it == pin2id.end())
   {
     pin thePin;
-		thePin.name = pinName;
+		thePin.name = intern_name(object_arena, pinName);
     thePin.id   = pins.size();
-    pin2id.insert(make_pair(pinName, thePin.id));
+    pin2id.insert(make_pair(thePin.name, thePin.id));
     pins.push_back(thePin);
+    pin_owner.push_back(numeric_limits<unsigned>::max());
+    pin_xoff.push_back(0.0);
+    pin_yoff.push_back(0.0);
+    pin_x.push_back(0.0);
+    pin_y.push_back(0.0);
     return &pins[pins.size()-1];
   }
   else
@@ -1605,13 +1811,16 @@ pin* circuit::locateOrCreatePin(const string &pinName)
 
 cell* circuit::locateOrCreateCell(const string &cellName)
 {
-  map<string, unsigned>::iterator it = cell2id.find(cellName);
+  name_map::iterator it = cell2id.find(cellName);
   if (it == cell2id.end())
   {
     cell theCell;
-    theCell.name = cellName;
+    theCell.name = intern_name(object_arena, cellName);
+    theCell.ports = id_list(arena_allocator<unsigned>(&object_arena));
     cell2id.insert(make_pair(theCell.name, cells.size()));
     cells.push_back(theCell);
+    cell_x.push_back(0);
+    cell_y.push_back(0);
     return &cells[cells.size()-1];
   }
   else
@@ -1620,7 +1829,7 @@ cell* circuit::locateOrCreateCell(const string &cellName)
 
 macro* circuit::locateOrCreateMacro(const string &macroName)
 {
-  map<string, unsigned>::iterator it = macro2id.find(macroName);
+  name_map::iterator it = macro2id.find(macroName);
   if (it == macro2id.end())
   {
     macro theMacro;
@@ -1635,11 +1844,14 @@ macro* circuit::locateOrCreateMacro(const string &macroName)
 
 net* circuit::locateOrCreateNet(const string &netName)
 {
-  map<string, unsigned>::iterator it = net2id.find(netName);
+  name_map::iterator it = net2id.find(netName);
   if (it == net2id.end())
   {
     net theNet;
-    theNet.name = netName;
+    theNet.name = intern_name(object_arena, netName);
+    theNet.sinks = id_list(arena_allocator<unsigned>(&object_arena));
+    theNet.wire_nodes = wire_node_list(arena_allocator<wire_node>(&object_arena));
+    theNet.wire_segs = wire_seg_list(arena_allocator<wire_seg>(&object_arena));
     net2id.insert(make_pair(theNet.name, nets.size()));
     nets.push_back(theNet);
     return &nets[nets.size()-1];
@@ -1650,11 +1862,11 @@ net* circuit::locateOrCreateNet(const string &netName)
 
 row* circuit::locateOrCreateRow(const string &rowName)
 {
-  map<string, unsigned>::iterator it = row2id.find(rowName);
+  name_map::iterator it = row2id.find(rowName);
   if (it == row2id.end())
   {
     row theRow;
-    theRow.name = rowName;
+    theRow.name = intern_name(object_arena, rowName);
     row2id.insert(make_pair(theRow.name, rows.size()));
     rows.push_back(theRow);
     return &rows[rows.size()-1];
@@ -1665,7 +1877,7 @@ row* circuit::locateOrCreateRow(const string &rowName)
 
 site* circuit::locateOrCreateSite(const string &siteName)
 {
-  map<string, unsigned>::iterator it = site2id.find(siteName);
+  name_map::iterator it = site2id.find(siteName);
   if (it == site2id.end())
   {
     site theSite;
@@ -1680,7 +1892,7 @@ site* circuit::locateOrCreateSite(const string &siteName)
 
 layer* circuit::locateOrCreateLayer(const string &layerName)
 {
-  map<string, unsigned>::iterator it = layer2id.find(layerName);
+  name_map::iterator it = layer2id.find(layerName);
   if (it == layer2id.end())
   {
     layer theLayer;
@@ -1782,16 +1994,212 @@ void get_next_n_tokens(ifstream &is, vector<string> &tokens, const unsigned numT
   } while (!is.eof() && count < numTokens);
 }
 
+/* ************************************************************************ */
+/*  Desc: compressed inputs (.gz, .bz2, .zst) and tar archive members,      */
+/*        given as <archive>.tar[.gz|.bz2|.zst]:<member>, are streamed      */
+/*        through an external decompressor. Returns "" for plain files.     */
+/* ************************************************************************ */
+static string quote_for_shell(const string &str)
+{
+  string quoted = "'";
+  for (unsigned i = 0; i < str.size(); ++i)
+  {
+    if (str[i] == '\'')
+      quoted += "'\\''";
+    else
+      quoted += str[i];
+  }
+  return quoted + "'";
+}
+
+static bool has_suffix(const string &str, const string &suffix)
+{
+  return str.size() >= suffix.size() && str.compare(str.size()-suffix.size(), suffix.size(), suffix) == 0;
+}
+
+string strip_compression_suffix(const string &input)
+{
+  static const char* suffixes[] = {".gz", ".bz2", ".zst"};
+  for (unsigned i = 0; i < sizeof(suffixes)/sizeof(suffixes[0]); ++i)
+    if (has_suffix(input, suffixes[i]))
+      return input.substr(0, input.size()-strlen(suffixes[i]));
+  return input;
+}
+
+string decompress_command(const string &input)
+{
+  static const char* archives[] = {".tar:", ".tar.gz:", ".tgz:", ".tar.bz2:", ".tbz2:", ".tar.zst:"};
+  for (unsigned i = 0; i < sizeof(archives)/sizeof(archives[0]); ++i)
+  {
+    size_t found = input.find(archives[i]);
+    if (found != string::npos)
+    {
+      size_t colon = found + strlen(archives[i]) - 1;
+      // NOTE: GNU tar detects the archive compression by itself
+      return "tar -xOf " + quote_for_shell(input.substr(0, colon)) + " " + quote_for_shell(input.substr(colon+1)) + " 2>/dev/null";
+    }
+  }
+  if (has_suffix(input, ".gz"))
+    return "gzip -dc " + quote_for_shell(input) + " 2>/dev/null";
+  if (has_suffix(input, ".bz2"))
+    return "bzip2 -dc " + quote_for_shell(input) + " 2>/dev/null";
+  if (has_suffix(input, ".zst"))
+    return "zstd -dcq " + quote_for_shell(input) + " 2>/dev/null";
+  return "";
+}
+
+/* open a (possibly compressed) input for reading, see decompress_command() */
+FILE* open_input(const string &input, bool &isPipe)
+{
+  string command = decompress_command(input);
+  isPipe = !command.empty();
+  return isPipe ? popen(command.c_str(), "r") : fopen(input.c_str(), "rb");
+}
+
+/* returns false if the input could not be read completely */
+bool close_input(FILE* fp, bool isPipe)
+{
+  // NOTE: a missing file or archive member only shows up as a failing decompressor
+  int status = isPipe ? pclose(fp) : fclose(fp);
+  return !isPipe || status == 0;
+}
+
+/* ********************************************************************* */
+/*  Desc: read a whole file into memory and split it into tokens.        */
+/*        LEF/DEF tokens are separated by whitespace, and a token        */
+/*        starting with beginComment comments out the rest of the line.  */
+/*        In line mode (verilog/SDC), special characters also separate   */
+/*        tokens and the first token of each non-empty line is recorded. */
+/*        Compressed inputs are tokenized chunk by chunk while the       */
+/*        decompressor is still running.                                 */
+/* ********************************************************************* */
+void token_stream::load(const string &input, const char* beginComment, bool lineMode)
+{
+  name  = input;
+  pos   = line = 0;
+  buffer.clear();
+  tokens.clear();
+  lines.clear();
+
+  bool isPipe;
+  FILE* fp = open_input(input, isPipe);
+  valid = (fp != NULL);
+  if (!valid)
+    return;
+
+  const size_t chunkSize = 1 << 20;
+  if (!isPipe && !fseek(fp, 0, SEEK_END))
+  {
+    long fileSize = ftell(fp);
+    if (fileSize > 0)
+      buffer.reserve(fileSize+1);
+    rewind(fp);
+  }
+
+  bool lineBegin = true;
+  size_t scanned = 0, size = 0;
+  bool done = false;
+  while (!done)
+  {
+    buffer.resize(size + chunkSize);
+    size_t bytes = fread(&buffer[size], 1, chunkSize, fp);
+    size += bytes;
+    done = (bytes < chunkSize);
+    buffer.resize(size);
+    scanned = scan(scanned, done, beginComment, lineMode, lineBegin);
+  }
+  buffer.push_back('\0');
+  valid = close_input(fp, isPipe);
+}
+
+/* ******************************************************************** */
+/*  Desc: tokenize buffer[begin, end). Unless this is the last chunk,   */
+/*        a token or comment running into the end of the buffer is left */
+/*        for the next call. Returns where the next call should resume. */
+/* ******************************************************************** */
+size_t token_stream::scan(size_t begin, bool lastChunk, const char* beginComment, bool lineMode, bool &lineBegin)
+{
+  const size_t commentLength = (beginComment == NULL) ? 0 : strlen(beginComment);
+  const size_t end = buffer.size();
+  size_t i = begin;
+  while (i < end)
+  {
+    char currChar = buffer[i];
+    if (currChar == '\n')
+      lineBegin = true;
+    if (isspace(currChar) || (lineMode && is_special_char(currChar)))
+    {
+      buffer[i++] = '\0';
+      continue;
+    }
+
+    size_t first = i;
+    if (commentLength != 0 && !strncmp(&buffer[i], beginComment, min(commentLength, end-i)))
+    {
+      if (!lastChunk && end-i < commentLength)
+        return first;
+      if (end-i >= commentLength)
+      {
+        while (i < end && buffer[i] != '\n')
+          ++i;
+        if (i == end && !lastChunk)
+          return first;
+        fill(buffer.begin()+first, buffer.begin()+i, '\0');
+        continue;
+      }
+    }
+
+    while (i < end && !isspace(buffer[i]) && !(lineMode && is_special_char(buffer[i])))
+      ++i;
+    if (i == end && !lastChunk)
+      return first;
+    if (lineMode && lineBegin)
+    {
+      lines.push_back(tokens.size());
+      lineBegin = false;
+    }
+    tokens.push_back(first);
+  }
+  return i;
+}
+
+bool read_line_as_tokens(token_stream &is, vector<string> &tokens)
+{
+  tokens.clear();
+  if (is.line >= is.lines.size())
+    return false;
+
+  unsigned first = is.lines[is.line];
+  unsigned last  = (is.line+1 < is.lines.size()) ? is.lines[is.line+1] : is.tokens.size();
+  for (unsigned i = first; i < last; ++i)
+    tokens.push_back(string(&is.buffer[ is.tokens[i] ]));
+  ++is.line;
+  return true;
+}
+
+// NOTE: comments are already stripped by token_stream::load()
+void get_next_token(token_stream &is, string &token, const char* beginComment)
+{
+  if (is.eof())
+    token.clear();
+  else
+    token.assign(is.next());
+}
+
+void get_next_n_tokens(token_stream &is, vector<string> &tokens, const unsigned numTokens, const char* beginComment)
+{
+  tokens.clear();
+  while (!is.eof() && tokens.size() < numTokens)
+    tokens.push_back(string(is.next()));
+}
+
 void pin::print()
 {
   cout << "|=== BEGIN PIN ===|  " << endl;
   cout << "name:                " << name << endl;
   cout << "id:                  " << id << endl;
   cout << "net:                 " << net << endl;
-  cout << "pin owner:           " << owner << endl;
   cout << "isFixed?             " << (isFixed ? "yes" : "no") << endl;
-  cout << "(x_coord,y_coord):   " << x_coord  << ", " << y_coord  << endl;
-  cout << "(x_offset,y_offset): " << x_offset << ", " << y_offset << endl;
   cout << "|===  END  PIN ===|  " << endl;
 }
 
@@ -1816,10 +2224,10 @@ void cell::print()
   cout << "type:               " << type << endl;
   cout << "orient:             " << cellorient << endl;
   cout << "isFixed?            " << (isFixed ? "true" : "false") << endl;
-	for (map<string, unsigned>::iterator it=ports.begin() ; it!=ports.end() ; it++)
-		cout << "port: "<< (*it).first  << " - " << (*it).second <<endl;
+	for (unsigned i=0 ; i<ports.size() ; i++)
+		if (ports[i] != numeric_limits<unsigned>::max())
+			cout << "port: "<< i  << " - " << ports[i] <<endl;
   cout << "(init_x,  init_y):  " << init_x_coord << ", " << init_y_coord << endl;
-  cout << "(x_coord,y_coord):  " << x_coord << ", " << y_coord << endl;
   cout << "[width,height]:      " << width << ", " << height << endl;
   cout << "row_num:            " << row_num << endl;
   cout << "|===  END  CELL ===|" << endl;
@@ -1936,19 +2344,19 @@ void circuit::write_bookshelf()
 			dot_nets << "\t\t" << pins[ theNet->source ].name << " I  : \t" << 0 << "\t" << 0 << endl;
 		else
 		{
-			cell *pinOwner = &cells[ pins[ theNet->source ].owner ];
+			cell *pinOwner = &cells[ pin_owner[ theNet->source ] ];
 			dot_nets << "\t\t" << pinOwner->name << " I  : ";
-			dot_nets << pins[ theNet->source ].x_offset - 0.5 * pinOwner->width << "\t" << pins[ theNet->source ].y_offset - 0.5 * pinOwner->height <<endl;
+			dot_nets << pin_xoff[ theNet->source ] - 0.5 * pinOwner->width << "\t" << pin_yoff[ theNet->source ] - 0.5 * pinOwner->height <<endl;
 		}
-		for(vector<unsigned>::iterator theSink = theNet->sinks.begin() ; theSink != theNet->sinks.end() ; ++theSink)
+		for(id_list::iterator theSink = theNet->sinks.begin() ; theSink != theNet->sinks.end() ; ++theSink)
 		{
 			if(pins[ *theSink ].type == PO_PIN)
 				dot_nets << "\t\t" << pins[ *theSink ].name << " O  : \t" << 0 << "\t" << 0 << endl;
 			else
 			{
-				cell *pinOwner = &cells[ pins[ *theSink ].owner ];
+				cell *pinOwner = &cells[ pin_owner[ *theSink ] ];
 				dot_nets << "\t\t" << pinOwner->name << " O  : ";
-				dot_nets << pins[ *theSink ].x_offset - 0.5 * pinOwner->width << "\t" << pins[ *theSink ].y_offset - 0.5 * pinOwner->height << endl;
+				dot_nets << pin_xoff[ *theSink ] - 0.5 * pinOwner->width << "\t" << pin_yoff[ *theSink ] - 0.5 * pinOwner->height << endl;
 			}
 		}
 	}
@@ -2002,9 +2410,9 @@ void circuit::write_bookshelf()
 		return;
 	dot_pl << "UCLA pl 1.0" <<endl << endl;
 	for(vector<unsigned>::iterator PI=PIs.begin() ; PI!=PIs.end() ; ++PI)
-		dot_pl << "\t\t" << pins[ *PI ].name << "\t\t" << pins[ *PI ].x_coord << "\t\t" << pins[ *PI ].y_coord << "\t : N /FIXED" <<endl;
+		dot_pl << "\t\t" << pins[ *PI ].name << "\t\t" << pin_x[ *PI ] << "\t\t" << pin_y[ *PI ] << "\t : N /FIXED" <<endl;
 	for(vector<unsigned>::iterator PO=POs.begin() ; PO!=POs.end() ; ++PO)
-		dot_pl << "\t\t" << pins[ *PO ].name << "\t\t" << pins[ *PO ].x_coord << "\t\t" << pins[ *PO ].y_coord << "\t : N /FIXED" <<endl;
+		dot_pl << "\t\t" << pins[ *PO ].name << "\t\t" << pin_x[ *PO ] << "\t\t" << pin_y[ *PO ] << "\t : N /FIXED" <<endl;
 	for(vector<cell>::iterator theCell = cells.begin() ; theCell != cells.end() ; ++theCell)
 	{
 		if(theCell->isFixed)
@@ -2044,7 +2452,7 @@ void circuit::convert_pl_to_def(const string thePlacer, const string identifier)
     if(!isMovable)
       dot_pl >> tmpStr;
 
-    map<string, unsigned>::iterator it=cell2id.find(tmpStr);
+    name_map::iterator it=cell2id.find(tmpStr);
     if(it==cell2id.end())
     {
       cout << "can't find a cell " <<tmpStr <<". exiting .." <<endl;
@@ -2070,12 +2478,285 @@ void circuit::convert_pl_to_def(const string thePlacer, const string identifier)
 }
 
 
+/* ******************************************************************* */
+/*  Desc: parse the .pl lines in text[begin, end) and move the cells    */
+/*        they name. Fixed cells keep their initial locations, like in  */
+/*        convert_pl_to_def(). Returns the number of unknown names.     */
+/* ******************************************************************* */
+unsigned circuit::read_bookshelf_pl_lines(const char* text, size_t begin, size_t end)
+{
+  unsigned unknown = 0;
+  size_t i = begin;
+  while (i < end)
+  {
+    size_t eol = i;
+    while (eol < end && text[eol] != '\n')
+      ++eol;
+
+    while (i < eol && isspace(text[i]))
+      ++i;
+    size_t nameEnd = i;
+    while (nameEnd < eol && !isspace(text[nameEnd]))
+      ++nameEnd;
+
+    // skip blank lines, comments and the "UCLA pl 1.0" header
+    if (nameEnd > i && text[i] != '#' && string(text+i, nameEnd-i) != "UCLA")
+    {
+      string cellName(text+i, nameEnd-i);
+      char* next;
+      double x_coord = strtod(text+nameEnd, &next);
+      double y_coord = strtod(next, &next);
+      name_map::const_iterator it = cell2id.find(cellName);
+      if (it != cell2id.end())
+      {
+        if (!cells[ it->second ].isFixed)
+        {
+          cell_x[ it->second ] = (int)floor(x_coord + 0.5);
+          cell_y[ it->second ] = (int)floor(y_coord + 0.5);
+        }
+      }
+      else if (pin2id.find(cellName) == pin2id.end())  // PIs & POs are terminals in .pl
+        ++unknown;
+    }
+    i = eol + 1;
+  }
+  return unknown;
+}
+
+/* ********************************************************************* */
+/*  Desc: apply a bookshelf .pl placement directly to the cells, without */
+/*        converting it to .def. The file is parsed in parallel chunks   */
+/*        split at line boundaries. cells that the .pl does not move     */
+/*        (fixed or missing) stay at their initial locations             */
+/* ********************************************************************* */
+void circuit::read_bookshelf_pl(const string &input)
+{
+  cout << "  .pl file        : "<< input <<endl;
+  bool isPipe;
+  FILE* fp = open_input(input, isPipe);
+  if (fp == NULL)
+  {
+    cerr << "read_bookshelf_pl:: cannot open `" << input << "' for reading." << endl;
+    exit(1);
+  }
+  vector<char> text;
+  const size_t chunkSize = 1 << 20;
+  size_t size = 0, bytes = 0;
+  do
+  {
+    text.resize(size + chunkSize);
+    bytes = fread(&text[size], 1, chunkSize, fp);
+    size += bytes;
+  } while (bytes == chunkSize);
+  text.resize(size);
+  if (!close_input(fp, isPipe))
+  {
+    cerr << "read_bookshelf_pl:: cannot open `" << input << "' for reading." << endl;
+    exit(1);
+  }
+  copy_init_to_final();
+
+  unsigned numThreads = max(1u, thread::hardware_concurrency());
+  numThreads = min(numThreads, (unsigned)(size / (1 << 16)) + 1);
+  vector<size_t> bounds(numThreads+1, size);
+  bounds[0] = 0;
+  for (unsigned t = 1; t < numThreads; ++t)
+  {
+    size_t bound = max(bounds[t-1], t * (size / numThreads));
+    while (bound < size && text[bound-1] != '\n')
+      ++bound;
+    bounds[t] = bound;
+  }
+
+  // NOTE: each cell appears on one line only, so the chunks never write the same cell
+  vector<unsigned> unknown(numThreads, 0);
+  if (size > 0)
+    run_threads(numThreads, [&](unsigned t) {
+      unknown[t] = read_bookshelf_pl_lines(&text[0], bounds[t], bounds[t+1]);
+    });
+
+  unsigned numUnknown = 0;
+  for (unsigned t = 0; t < numThreads; ++t)
+    numUnknown += unknown[t];
+  if (numUnknown != 0)
+    cout << "read_bookshelf_pl:: WARNING -- " << numUnknown << " unknown node(s) are ignored." << endl;
+}
+
+/* output buffer for write_def(): formats straight into a large buffer */
+/* with integer fast paths, and only goes to the file when it is full; */
+/* a failed write (e.g. a full disk) is fatal, as a truncated DEF is   */
+class def_buffer
+{
+  private:
+    FILE* fp;
+    string name;
+    vector<char> buf;
+    size_t used;
+
+    void write(const char* str, size_t len)
+    {
+      if (fwrite(str, 1, len, fp) != len)
+      {
+        cerr << "write_def:: cannot write to `" << name << "'." << endl;
+        exit(1);
+      }
+    }
+
+    void reserve(size_t n)
+    {
+      if (used + n > buf.size())
+        flush();
+    }
+
+  public:
+    def_buffer(FILE* out, const string &outName) : fp(out), name(outName), buf(1 << 22), used(0) {}
+
+    void flush()
+    {
+      write(&buf[0], used);
+      used = 0;
+    }
+    def_buffer& operator<<(const char* str)
+    {
+      size_t len = strlen(str);
+      if (len > buf.size())
+      {
+        flush();
+        write(str, len);
+        return *this;
+      }
+      reserve(len);
+      memcpy(&buf[used], str, len);
+      used += len;
+      return *this;
+    }
+    def_buffer& operator<<(const string &str)
+    {
+      return *this << str.c_str();
+    }
+    def_buffer& operator<<(long long value)
+    {
+      char digits[24];
+      char* p = digits + sizeof(digits);
+      unsigned long long u = (value < 0) ? 0ULL - (unsigned long long)value : value;
+      do
+      {
+        *--p = '0' + u % 10;
+        u /= 10;
+      } while (u);
+      if (value < 0)
+        *--p = '-';
+      size_t len = digits + sizeof(digits) - p;
+      reserve(len);
+      memcpy(&buf[used], p, len);
+      used += len;
+      return *this;
+    }
+    def_buffer& operator<<(int value)      { return *this << (long long)value; }
+    def_buffer& operator<<(unsigned value) { return *this << (long long)value; }
+    // NOTE: DEF coordinates are integers, so doubles only fall back to printf for fractions
+    def_buffer& operator<<(double value)
+    {
+      if (value == floor(value) && fabs(value) < 1e18)
+        return *this << (long long)value;
+      char str[32];
+      snprintf(str, sizeof(str), "%.10g", value);
+      return *this << str;
+    }
+};
+
+/* ******************************************************************** */
+/*  Desc: write the current placement as a complete .def file (rows,    */
+/*        components, pins and nets) in a single pass                   */
+/* ******************************************************************** */
+void circuit::write_def(const string &output)
+{
+	FILE* fp = fopen(output.c_str(), "w");
+	if(fp == NULL)
+	{
+		cerr << "write_def:: cannot open `" << output << "' for writing." << endl;
+		return;
+	}
+	def_buffer dot_def(fp, output);
+
+	dot_def << "VERSION " << (DEFVersion.empty() ? string("5.7") : DEFVersion) << " ;\n";
+	dot_def << "DIVIDERCHAR \"" << DEFDelimiter << "\" ;\n";
+	dot_def << "BUSBITCHARS \"" << DEFBusCharacters << "\" ;\n";
+	dot_def << "DESIGN " << (design_name.empty() ? benchmark : design_name) << " ;\n\n";
+	dot_def << "UNITS DISTANCE MICRONS " << DEFdist2Microns << " ;\n\n";
+	dot_def << "DIEAREA ( " << lx << " " << by << " ) ( " << rx << " " << ty << " ) ;\n\n";
+
+	for(vector<row>::iterator theRow = rows.begin() ; theRow != rows.end() ; ++theRow)
+	{
+		dot_def << "ROW " << theRow->name << " " << sites[ theRow->site ].name << " " << theRow->origX << " " << theRow->origY;
+		dot_def << " " << theRow->siteorient << " DO " << theRow->numSites << " BY 1 STEP " << theRow->stepX << " " << theRow->stepY << " ;\n";
+	}
+	dot_def << "\n";
+
+	dot_def << "COMPONENTS " << (unsigned)cells.size() << " ;\n";
+	for(unsigned i=0 ; i<cells.size() ; i++)
+	{
+		cell *theCell = &cells[i];
+		dot_def << "   - " << theCell->name << " " << macros[ theCell->type ].name << "\n";
+		dot_def << (theCell->isFixed ? "      + FIXED ( " : "      + PLACED ( ") << cell_x[i] << " " << cell_y[i] << " ) ";
+		dot_def << (theCell->cellorient.empty() ? string("N") : theCell->cellorient) << " ;\n";
+	}
+	dot_def << "END COMPONENTS\n\n";
+
+	dot_def << "PINS " << (unsigned)(PIs.size() + POs.size()) << " ;\n";
+	for(unsigned i=0 ; i<PIs.size()+POs.size() ; i++)
+	{
+		pin *thePin = &pins[ i < PIs.size() ? PIs[i] : POs[i-PIs.size()] ];
+		dot_def << "   - " << thePin->name << " + NET " << nets[ thePin->net ].name << "\n";
+		dot_def << (thePin->type == PI_PIN ? "      + DIRECTION INPUT\n" : "      + DIRECTION OUTPUT\n");
+		// NOTE: pin_x/pin_y is the center of the pin shape, not its placed location
+		dot_def << (thePin->isFixed ? "      + FIXED ( " : "      + PLACED ( ");
+		dot_def << pin_x[ thePin->id ] - 0.5 * (thePin->xLL + thePin->xUR) << " " << pin_y[ thePin->id ] - 0.5 * (thePin->yLL + thePin->yUR) << " ) N";
+		if(thePin->layer != numeric_limits<unsigned>::max())
+		{
+			dot_def << "\n      + LAYER " << layers[ thePin->layer ].name;
+			dot_def << " ( " << thePin->xLL << " " << thePin->yLL << " ) ( " << thePin->xUR << " " << thePin->yUR << " )";
+		}
+		dot_def << " ;\n";
+	}
+	dot_def << "END PINS\n\n";
+
+	dot_def << "NETS " << (unsigned)nets.size() << " ;\n";
+	for(vector<net>::iterator theNet = nets.begin() ; theNet != nets.end() ; ++theNet)
+	{
+		dot_def << "   - " << theNet->name;
+		unsigned first = (theNet->source == numeric_limits<unsigned>::max()) ? 1 : 0;
+		for(unsigned i=first ; i<=theNet->sinks.size() ; i++)
+		{
+			pin *thePin = &pins[ i == 0 ? theNet->source : theNet->sinks[i-1] ];
+			if(pin_owner[ thePin->id ] == numeric_limits<unsigned>::max())
+				dot_def << " ( PIN " << thePin->name << " )";
+			else
+			{
+				// NOTE: pin name = cell instance name + "/" + port name
+				const name_ref &owner = cells[ pin_owner[ thePin->id ] ].name;
+				dot_def << " ( " << owner << " " << thePin->name.c_str() + owner.size() + 1 << " )";
+			}
+		}
+		dot_def << " ;\n";
+	}
+	dot_def << "END NETS\n\n";
+	dot_def << "END DESIGN\n";
+	dot_def.flush();
+	if(fclose(fp) != 0)
+	{
+		cerr << "write_def:: cannot write to `" << output << "'." << endl;
+		exit(1);
+	}
+	return;
+}
+
 void circuit::copy_init_to_final()
 {
-  for(vector<cell>::iterator theCell=cells.begin() ; theCell != cells.end() ; ++theCell)
+  for(unsigned i=0 ; i<cells.size() ; i++)
 	{
-		theCell->x_coord = theCell->init_x_coord;
-		theCell->y_coord = theCell->init_y_coord;
+		cell_x[i] = cells[i].init_x_coord;
+		cell_y[i] = cells[i].init_y_coord;
 	}
 
 	return;
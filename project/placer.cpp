@@ -36,10 +36,10 @@ int main(int argc, char** argv)
   
 
   
-  string thePlacer = "placer";
-  string identifier = "";
-  ckt.write_bookshelf();
-  ckt.convert_pl_to_def(thePlacer,identifier);
+  string output(argv[1]);
+  output = strip_compression_suffix(output.substr(output.find_last_of("/\\")+1));
+  output = output.substr(0, output.find_last_of(".")) + "_placer.def";
+  ckt.write_def(output);
 
   return 1;
 }